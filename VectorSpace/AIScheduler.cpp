@@ -0,0 +1,37 @@
+#include "AIScheduler.h"
+#include "GameData.h"
+
+#include <chrono>
+
+void AIScheduler::run(GameState* state) {
+	PROFILE_ZONE("AIScheduler::run");
+	EntityWorld& entities = state->entities;
+	int total = entities.count();
+	thoughtLastTick = 0;
+	coverage = 1;
+	if (total == 0) {
+		return;
+	}
+	if (cursor >= total) {
+		cursor = 0; // entities were removed since the last tick
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	while (thoughtLastTick < total) {
+		// cursor counts through the archetypes one after another
+		int kind = 0;
+		int index = cursor;
+		while (index >= entities.archetypes[kind].size()) {
+			index -= entities.archetypes[kind].size();
+			kind++;
+		}
+		thinkEntity(state, kind, index);
+		thoughtLastTick++;
+		cursor = (cursor + 1) % total;
+
+		if (budgetMicros > 0 and std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() >= budgetMicros) {
+			break;
+		}
+	}
+	coverage = (double)thoughtLastTick / total;
+}
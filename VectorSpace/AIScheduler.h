@@ -0,0 +1,26 @@
+/*
+* Spreads the entities' decisions over ticks.
+* Thinking (which city a cargo ship heads for, where a pirate wants to be and whether it is close enough to shoot,
+* and the way around the bodies in between) is done for a few entities each tick, taking turns so every entity
+* gets the same share. Each tick thinks until its budget of time is spent, so the cost stays the same as the
+* population grows and entities just think less often. Movement still runs every tick from the last decision.
+*/
+
+#pragma once
+
+struct GameState;
+
+static const double AITHINKBUDGET = 250; // default microseconds of thinking per tick for every entity together
+
+class AIScheduler {
+private:
+	int cursor = 0; // the next entity to think, over the archetypes in order
+public:
+	double budgetMicros = AITHINKBUDGET; // 0 or less thinks for every entity every tick, for runs that must repeat
+	int thoughtLastTick = 0;
+	double coverage = 1; // share of the entities that thought last tick
+
+	// Thinks for entities in turn from where the last tick left off until the budget is spent,
+	// at least one and each at most once. Called once per update before the entities move.
+	void run(GameState* state);
+};
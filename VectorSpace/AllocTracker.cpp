@@ -0,0 +1,45 @@
+#include "AllocTracker.h"
+#include "Profiler.h"
+
+#include <cstdlib>
+#include <new>
+
+// Constant initialised with nothing to destroy, operator new can run before anything else on a thread.
+static thread_local AllocCounts counts;
+
+AllocCounts AllocTracker::thisThread() {
+	return counts;
+}
+
+void* operator new(std::size_t size) {
+	counts.count++;
+	counts.bytes += (long long)size;
+#ifdef VS_PROFILE
+	Profiler::countAllocation(size);
+#endif
+	void* memory = malloc(size == 0 ? 1 : size);
+	if (memory == nullptr) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, std::size_t size) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory, std::size_t size) noexcept {
+	free(memory);
+}
@@ -0,0 +1,18 @@
+/*
+* Counts heap allocations by replacing the global operator new.
+* Every thread keeps its own running totals, read them before and after a piece of work to see what it allocated.
+* In VS_PROFILE builds each allocation is also charged to the profiler zone it happened in, see Profiler.h.
+*/
+
+#pragma once
+
+struct AllocCounts {
+	long long count = 0;
+	long long bytes = 0;
+};
+
+class AllocTracker {
+public:
+	// Everything the calling thread has allocated since it started.
+	static AllocCounts thisThread();
+};
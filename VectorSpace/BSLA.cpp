@@ -1,6 +1,8 @@
 #include "BSLA.h"
 
-Vector2D rotateVector2D(Vector2D toRotate, float delta) {
-	Matrix2D rm = Matrix2D(cos(delta), -1 * sin(delta), sin(delta), cos(delta));
+Vector2D rotateVector2D(const Vector2D& toRotate, float delta) {
+	simScalar c = cos(delta);
+	simScalar s = sin(delta);
+	Matrix2D rm = Matrix2D(c, -1 * s, s, c);
 	return rm * toRotate;
 }
\ No newline at end of file
@@ -8,138 +8,209 @@ Bill's Simple Linear Algebra
 #include <math.h>
 
 /*
-* Class for a two-dimensional vector with some basic linear algebra operations built in.
+* Vector arithmetic is built as expression templates, a + b * s does not make a Vector2D for each operator,
+* it makes a small expression object that is only evaluated when it is assigned to a Vector2D.
+* The compiler can then turn a whole chain into straight line code with no temporaries.
+*
+* Expressions hold references to the Vector2Ds they were built from, so they must be used within the
+* statement that made them. Never keep one in an auto variable, assign it to a Vector2D instead.
+*
+* Everything is templated on the scalar type T. Vector2D and Matrix2D are the simulation's precision,
+* see simScalar below, Vec2<float> and Vec2<double> can be used directly when a fixed precision is needed.
+* Expressions only combine vectors of the same scalar type, convert explicitly with Vec2<T>(other).
 */
-class Vector2D {
+
+template <typename T> class Vec2;
+template <typename L, typename R> class VectorSum;
+template <typename L, typename R> class VectorDifference;
+template <typename E> class VectorScaled;
+
+// Vec2 leaves are held by reference, other expressions are small and held by value.
+template <typename E> struct ExprStorage { typedef const E type; };
+template <typename T> struct ExprStorage<Vec2<T>> { typedef const Vec2<T>& type; };
+
+// Keeps a scalar parameter out of template deduction so v * 2 works for any T.
+template <typename T> struct ScalarArg { typedef T type; };
+
+/*
+* The base of every vector expression, E provides evalX() and evalY() as T.
+*/
+template <typename E, typename T>
+class VectorExpr {
 public:
-	double x; double y;
-	Vector2D() {
-		x = 0; y = 0;
-	}
-	Vector2D(double x1, double y1) {
-		x = x1; y = y1;
-	}
-	Vector2D operator+(Vector2D vect) {
-		Vector2D sum;
-		sum.x = x + vect.x;
-		sum.y = y + vect.y;
-		return sum;
+	constexpr const E& self() const { return static_cast<const E&>(*this); }
+
+	template <typename R>
+	constexpr T dot(const VectorExpr<R, T>& vect) const {
+		return (self().evalX() * vect.self().evalX()) + (self().evalY() * vect.self().evalY());
 	}
-	Vector2D operator-(Vector2D vect) {
-		Vector2D dif;
-		dif.x = x - vect.x;
-		dif.y = y - vect.y;
-		return dif;
+	constexpr T magnitudeSquared() const {
+		return (self().evalX() * self().evalX()) + (self().evalY() * self().evalY());
 	}
-	Vector2D operator*(double scalar) {
-		Vector2D product;
-		product.x = x * scalar;
-		product.y = y * scalar;
-		return product;
+	T magnitude() const {
+		return sqrt(magnitudeSquared());
 	}
-	bool operator==(Vector2D vect) {
-		return (x == vect.x) and (y == vect.y);
+	// is this vector longer than toCMP
+	template <typename R>
+	constexpr bool cmpMag(const VectorExpr<R, T>& toCMP) const {
+		return magnitudeSquared() > toCMP.magnitudeSquared();
 	}
-	bool cmpMag(Vector2D toCMP) {
-		return (abs(x * x) + abs(y * y)) > abs(toCMP.x * toCMP.x) + abs(toCMP.y * toCMP.y);
+	VectorScaled<E> normalize() const {
+		return VectorScaled<E>(self(), T(1) / magnitude());
 	}
-	double dot(Vector2D vect) {
-		return (x * vect.x) + (y * vect.y);
+	template <typename R>
+	VectorScaled<R> proj(const VectorExpr<R, T>& a) const { // project this vector onto a
+		return VectorScaled<R>(a.self(), a.dot(*this) * (T(1) / a.magnitudeSquared()));
 	}
-	double magnitude() {
-		return sqrt(abs(x * x) + abs(y * y));
+	std::string toString() const {
+		return "[" + std::to_string(self().evalX()) + " " + std::to_string(self().evalY()) + "]";
 	}
-	Vector2D normalize() {
+};
 
-		return Vector2D(x,y) * (1 / Vector2D(x, y).magnitude());
-	}
-	Vector2D proj(Vector2D a) { // project this vector onto a
-		Vector2D b = Vector2D(x, y);
-		double osqr = a.magnitude() * a.magnitude();
-		return a * (a.dot(b) * (1/ osqr));
-	}
-	std::string toString() {
-		return "[" + std::to_string(x) + " " + std::to_string(y) + "]";
+/*
+* Class for a two-dimensional vector with some basic linear algebra operations built in.
+*/
+template <typename T>
+class Vec2 : public VectorExpr<Vec2<T>, T> {
+public:
+	typedef T scalar;
+	T x; T y;
+	constexpr Vec2() : x(0), y(0) {}
+	constexpr Vec2(T x1, T y1) : x(x1), y(y1) {}
+	template <typename E>
+	constexpr Vec2(const VectorExpr<E, T>& expr) : x(expr.self().evalX()), y(expr.self().evalY()) {}
+	constexpr Vec2(const Vec2& vect) = default;
+	// Changing precision has to be asked for.
+	template <typename U>
+	constexpr explicit Vec2(const Vec2<U>& vect) : x(T(vect.x)), y(T(vect.y)) {}
+
+	// Both components are evaluated before either is written so v = v.normalize() and the like are safe.
+	template <typename E>
+	Vec2& operator=(const VectorExpr<E, T>& expr) {
+		T newX = expr.self().evalX();
+		T newY = expr.self().evalY();
+		x = newX; y = newY;
+		return *this;
+	}
+	Vec2& operator=(const Vec2& vect) = default;
+
+	constexpr T evalX() const { return x; }
+	constexpr T evalY() const { return y; }
+
+	template <typename E>
+	constexpr bool operator==(const VectorExpr<E, T>& vect) const {
+		return (x == vect.self().evalX()) and (y == vect.self().evalY());
 	}
 };
 
+template <typename L, typename R>
+class VectorSum : public VectorExpr<VectorSum<L, R>, typename L::scalar> {
+	typename ExprStorage<L>::type l;
+	typename ExprStorage<R>::type r;
+public:
+	typedef typename L::scalar scalar;
+	constexpr VectorSum(const L& left, const R& right) : l(left), r(right) {}
+	constexpr scalar evalX() const { return l.evalX() + r.evalX(); }
+	constexpr scalar evalY() const { return l.evalY() + r.evalY(); }
+};
+
+template <typename L, typename R>
+class VectorDifference : public VectorExpr<VectorDifference<L, R>, typename L::scalar> {
+	typename ExprStorage<L>::type l;
+	typename ExprStorage<R>::type r;
+public:
+	typedef typename L::scalar scalar;
+	constexpr VectorDifference(const L& left, const R& right) : l(left), r(right) {}
+	constexpr scalar evalX() const { return l.evalX() - r.evalX(); }
+	constexpr scalar evalY() const { return l.evalY() - r.evalY(); }
+};
+
+template <typename E>
+class VectorScaled : public VectorExpr<VectorScaled<E>, typename E::scalar> {
+public:
+	typedef typename E::scalar scalar;
+private:
+	typename ExprStorage<E>::type v;
+	scalar s;
+public:
+	constexpr VectorScaled(const E& vect, scalar factor) : v(vect), s(factor) {}
+	constexpr scalar evalX() const { return v.evalX() * s; }
+	constexpr scalar evalY() const { return v.evalY() * s; }
+};
+
+template <typename L, typename R, typename T>
+constexpr VectorSum<L, R> operator+(const VectorExpr<L, T>& left, const VectorExpr<R, T>& right) {
+	return VectorSum<L, R>(left.self(), right.self());
+}
+template <typename L, typename R, typename T>
+constexpr VectorDifference<L, R> operator-(const VectorExpr<L, T>& left, const VectorExpr<R, T>& right) {
+	return VectorDifference<L, R>(left.self(), right.self());
+}
+template <typename E, typename T>
+constexpr VectorScaled<E> operator*(const VectorExpr<E, T>& vect, typename ScalarArg<T>::type scalar) {
+	return VectorScaled<E>(vect.self(), scalar);
+}
+
 /*
 * Class for a 2x2 matrix and some basic operators related to it.
-* This class uses the Vector2D class for it's rows.
-* 
+* This class uses the Vec2 class for it's rows.
+* A 2x2 product is only a few multiplies so these are evaluated straight away rather than as expressions.
+*
 * |v1.x v1.y|
-* |v2.x v2.y| 
+* |v2.x v2.y|
 */
-class Matrix2D {
+template <typename T>
+class Mat2 {
 public:
-	Vector2D v1; Vector2D v2;
-	Matrix2D() {
-		v1.x = 0; v1.y = 0;
-		v2.x = 0; v2.y = 0;
-	}
-	Matrix2D(double x1, double y1, double x2, double y2) {
-		v1.x = x1; v1.y = y1;
-		v2.x = x2; v2.y = y2;
-	}
-	Matrix2D operator+(Matrix2D matrix) {
-		Matrix2D sum;
-		sum.v1.x = v1.x + matrix.v1.x;
-		sum.v1.y = v1.y + matrix.v1.y;
-		sum.v2.x = v2.x + matrix.v2.x;
-		sum.v2.y = v2.y + matrix.v2.y;
-		return sum;
-	}
-	Matrix2D operator-(Matrix2D matrix) {
-		Matrix2D dif;
-		dif.v1.x = v1.x - matrix.v1.x;
-		dif.v1.y = v1.y - matrix.v1.y;
-		dif.v2.x = v2.x - matrix.v2.x;
-		dif.v2.y = v2.y - matrix.v2.y;
-		return dif;
-	}
-	Matrix2D operator*(Matrix2D matrix) {
-		Matrix2D product;
-		product.v1.x = (v1.x * matrix.v1.x) + (v2.x * matrix.v1.y);
-		product.v1.y = (v1.y * matrix.v1.x) + (v2.y * matrix.v1.y);
-		product.v2.x = (v1.x * matrix.v2.x) + (v2.x * matrix.v2.y);
-		product.v2.y = (v1.y * matrix.v2.x) + (v2.y * matrix.v2.y);
-		return product;
-	}
-	Vector2D operator*(Vector2D vector) {
-		Vector2D product;
-		product.x = (v1.x * vector.x) + (v2.x * vector.y);
-		product.y = (v1.y * vector.x) + (v2.y * vector.y);
-		return product;
-	}
-	Matrix2D operator*(double scalar) {
-		Matrix2D product;
-		product.v1 = v1 * scalar;
-		product.v2 = v2 * scalar;
-		return product;
-	}
-	Matrix2D inverse() {
-		Matrix2D inverse;
-		inverse.v1.x = v2.y;
-		inverse.v1.y = -1 * v1.y;
-		inverse.v2.x = -1 * v2.x;
-		inverse.v2.y = v1.x;
-		inverse = inverse * (1.0 / ((v1.x * v2.y) - (v2.x * v1.y)));
-		return inverse;
-	}
-	Matrix2D transpose() {
-		Matrix2D transpose;
-		transpose.v1.x = v1.x;
-		transpose.v1.y = v2.x;
-		transpose.v2.x = v1.y;
-		transpose.v2.y = v2.y;
-		return transpose;
-	}
-	double det() {
+	Vec2<T> v1; Vec2<T> v2;
+	constexpr Mat2() : v1(0, 0), v2(0, 0) {}
+	constexpr Mat2(T x1, T y1, T x2, T y2) : v1(x1, y1), v2(x2, y2) {}
+	constexpr Mat2 operator+(const Mat2& matrix) const {
+		return Mat2(v1.x + matrix.v1.x, v1.y + matrix.v1.y, v2.x + matrix.v2.x, v2.y + matrix.v2.y);
+	}
+	constexpr Mat2 operator-(const Mat2& matrix) const {
+		return Mat2(v1.x - matrix.v1.x, v1.y - matrix.v1.y, v2.x - matrix.v2.x, v2.y - matrix.v2.y);
+	}
+	constexpr Mat2 operator*(const Mat2& matrix) const {
+		return Mat2(
+			(v1.x * matrix.v1.x) + (v2.x * matrix.v1.y),
+			(v1.y * matrix.v1.x) + (v2.y * matrix.v1.y),
+			(v1.x * matrix.v2.x) + (v2.x * matrix.v2.y),
+			(v1.y * matrix.v2.x) + (v2.y * matrix.v2.y));
+	}
+	template <typename E>
+	constexpr Vec2<T> operator*(const VectorExpr<E, T>& vector) const {
+		return product(vector.self().evalX(), vector.self().evalY());
+	}
+	constexpr Vec2<T> product(T x, T y) const {
+		return Vec2<T>((v1.x * x) + (v2.x * y), (v1.y * x) + (v2.y * y));
+	}
+	constexpr Mat2 operator*(T scalar) const {
+		return Mat2(v1.x * scalar, v1.y * scalar, v2.x * scalar, v2.y * scalar);
+	}
+	constexpr Mat2 inverse() const {
+		return Mat2(v2.y, -1 * v1.y, -1 * v2.x, v1.x) * (T(1) / det());
+	}
+	constexpr Mat2 transpose() const {
+		return Mat2(v1.x, v2.x, v1.y, v2.y);
+	}
+	constexpr T det() const {
 		return (v1.x * v2.y) - (v2.x * v1.y);
 	}
-	std::string toString() {
+	std::string toString() const {
 		return "[" + std::to_string(v1.x) + " " + std::to_string(v1.y) + "]" + "[" + std::to_string(v2.x) + " " + std::to_string(v2.y) + "]";
 	}
 };
 
-Vector2D rotateVector2D(Vector2D toRotate, float delta);
\ No newline at end of file
+// Precision of the GameData physics, double unless the build defines VS_FLOAT_SIM.
+// A float build halves the memory of every vector and doubles how many fit in a SIMD register.
+#ifdef VS_FLOAT_SIM
+typedef float simScalar;
+#else
+typedef double simScalar;
+#endif
+
+typedef Vec2<simScalar> Vector2D;
+typedef Mat2<simScalar> Matrix2D;
+
+Vector2D rotateVector2D(const Vector2D& toRotate, float delta);
\ No newline at end of file
@@ -0,0 +1,331 @@
+/*
+* Packed versions of the BSLA types for running the same math on several objects at once.
+* A lanes value holds LANES scalars, a Vec2Lanes holds LANES vectors as one x and one y pack (SoA).
+*
+* With AVX (/arch:AVX or higher) each pack is one register of 4 doubles (Vector2Dx4) or 8 floats (Vector2Dx8).
+* Otherwise x64 always has SSE2, 2 doubles or 4 floats. Without either, or with VS_NO_SIMD defined,
+* a pack is a single value and the code is plain scalar math. Code written against these types is the same either way.
+*/
+
+#pragma once
+
+#include <math.h>
+
+#include "BSLA.h"
+
+#if defined(VS_NO_SIMD)
+#elif defined(__AVX__)
+#define VS_LANES_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VS_LANES_SSE2
+#include <emmintrin.h>
+#endif
+
+// Index of the first set lane in a mask's bits, bits must not be 0.
+inline int firstLane(int bits) {
+	int lane = 0;
+	while ((bits & 1) == 0) {
+		bits >>= 1;
+		lane++;
+	}
+	return lane;
+}
+
+/*
+* Scalar fallback, a single lane so the code is plain one body at a time math.
+*/
+template <typename T>
+class LaneMask {
+public:
+	static const int LANES = 1;
+	bool m;
+	LaneMask() {}
+	LaneMask(bool mask) : m(mask) {}
+	// one bit per lane, lane 0 is the lowest bit
+	int bits() const { return (int)m; }
+	LaneMask operator&(const LaneMask& other) const { return m and other.m; }
+	LaneMask operator|(const LaneMask& other) const { return m or other.m; }
+	LaneMask operator!() const { return !m; }
+};
+
+template <typename T>
+class ScalarLanes {
+public:
+	static const int LANES = 1;
+	T v;
+	ScalarLanes() : v(0) {}
+	ScalarLanes(T s) : v(s) {}
+	static ScalarLanes load(const T* p) { return *p; }
+	void store(T* p) const { *p = v; }
+
+	ScalarLanes operator+(const ScalarLanes& other) const { return v + other.v; }
+	ScalarLanes operator-(const ScalarLanes& other) const { return v - other.v; }
+	ScalarLanes operator*(const ScalarLanes& other) const { return v * other.v; }
+	ScalarLanes operator/(const ScalarLanes& other) const { return v / other.v; }
+	LaneMask<T> operator<(const ScalarLanes& other) const { return v < other.v; }
+	LaneMask<T> operator<=(const ScalarLanes& other) const { return v <= other.v; }
+	LaneMask<T> operator>(const ScalarLanes& other) const { return v > other.v; }
+	LaneMask<T> operator>=(const ScalarLanes& other) const { return v >= other.v; }
+	LaneMask<T> operator==(const ScalarLanes& other) const { return v == other.v; }
+	LaneMask<T> operator!=(const ScalarLanes& other) const { return v != other.v; }
+
+	ScalarLanes sqrt() const { return ::sqrt(v); }
+	// adds the lanes together
+	T sum() const { return v; }
+	// one bit per lane, set where the sign bit is
+	int signBits() const { return (int)signbit(v); }
+	// picks a where mask is set, b elsewhere
+	static ScalarLanes select(const LaneMask<T>& mask, const ScalarLanes& a, const ScalarLanes& b) {
+		return mask.m ? a : b;
+	}
+};
+
+#if defined(VS_LANES_SSE2)
+
+/*
+* SSE2, 2 doubles per register.
+*/
+template <>
+class LaneMask<double> {
+public:
+	static const int LANES = 2;
+	__m128d m;
+	LaneMask() {}
+	LaneMask(__m128d mask) : m(mask) {}
+	int bits() const { return _mm_movemask_pd(m); }
+	LaneMask operator&(const LaneMask& other) const { return _mm_and_pd(m, other.m); }
+	LaneMask operator|(const LaneMask& other) const { return _mm_or_pd(m, other.m); }
+	LaneMask operator!() const { return _mm_xor_pd(m, _mm_castsi128_pd(_mm_set1_epi32(-1))); }
+};
+
+template <>
+class ScalarLanes<double> {
+public:
+	static const int LANES = 2;
+	__m128d v;
+	ScalarLanes() : v(_mm_setzero_pd()) {}
+	ScalarLanes(double s) : v(_mm_set1_pd(s)) {}
+	ScalarLanes(__m128d value) : v(value) {}
+	static ScalarLanes load(const double* p) { return _mm_loadu_pd(p); }
+	void store(double* p) const { _mm_storeu_pd(p, v); }
+
+	ScalarLanes operator+(const ScalarLanes& other) const { return _mm_add_pd(v, other.v); }
+	ScalarLanes operator-(const ScalarLanes& other) const { return _mm_sub_pd(v, other.v); }
+	ScalarLanes operator*(const ScalarLanes& other) const { return _mm_mul_pd(v, other.v); }
+	ScalarLanes operator/(const ScalarLanes& other) const { return _mm_div_pd(v, other.v); }
+	LaneMask<double> operator<(const ScalarLanes& other) const { return _mm_cmplt_pd(v, other.v); }
+	LaneMask<double> operator<=(const ScalarLanes& other) const { return _mm_cmple_pd(v, other.v); }
+	LaneMask<double> operator>(const ScalarLanes& other) const { return _mm_cmpgt_pd(v, other.v); }
+	LaneMask<double> operator>=(const ScalarLanes& other) const { return _mm_cmpge_pd(v, other.v); }
+	LaneMask<double> operator==(const ScalarLanes& other) const { return _mm_cmpeq_pd(v, other.v); }
+	LaneMask<double> operator!=(const ScalarLanes& other) const { return _mm_cmpneq_pd(v, other.v); }
+
+	ScalarLanes sqrt() const { return _mm_sqrt_pd(v); }
+	double sum() const {
+		double lanes[LANES];
+		store(lanes);
+		return lanes[0] + lanes[1];
+	}
+	int signBits() const { return _mm_movemask_pd(v); }
+	static ScalarLanes select(const LaneMask<double>& mask, const ScalarLanes& a, const ScalarLanes& b) {
+		return _mm_or_pd(_mm_and_pd(mask.m, a.v), _mm_andnot_pd(mask.m, b.v));
+	}
+};
+
+/*
+* SSE2, 4 floats per register.
+*/
+template <>
+class LaneMask<float> {
+public:
+	static const int LANES = 4;
+	__m128 m;
+	LaneMask() {}
+	LaneMask(__m128 mask) : m(mask) {}
+	int bits() const { return _mm_movemask_ps(m); }
+	LaneMask operator&(const LaneMask& other) const { return _mm_and_ps(m, other.m); }
+	LaneMask operator|(const LaneMask& other) const { return _mm_or_ps(m, other.m); }
+	LaneMask operator!() const { return _mm_xor_ps(m, _mm_castsi128_ps(_mm_set1_epi32(-1))); }
+};
+
+template <>
+class ScalarLanes<float> {
+public:
+	static const int LANES = 4;
+	__m128 v;
+	ScalarLanes() : v(_mm_setzero_ps()) {}
+	ScalarLanes(float s) : v(_mm_set1_ps(s)) {}
+	ScalarLanes(__m128 value) : v(value) {}
+	static ScalarLanes load(const float* p) { return _mm_loadu_ps(p); }
+	void store(float* p) const { _mm_storeu_ps(p, v); }
+
+	ScalarLanes operator+(const ScalarLanes& other) const { return _mm_add_ps(v, other.v); }
+	ScalarLanes operator-(const ScalarLanes& other) const { return _mm_sub_ps(v, other.v); }
+	ScalarLanes operator*(const ScalarLanes& other) const { return _mm_mul_ps(v, other.v); }
+	ScalarLanes operator/(const ScalarLanes& other) const { return _mm_div_ps(v, other.v); }
+	LaneMask<float> operator<(const ScalarLanes& other) const { return _mm_cmplt_ps(v, other.v); }
+	LaneMask<float> operator<=(const ScalarLanes& other) const { return _mm_cmple_ps(v, other.v); }
+	LaneMask<float> operator>(const ScalarLanes& other) const { return _mm_cmpgt_ps(v, other.v); }
+	LaneMask<float> operator>=(const ScalarLanes& other) const { return _mm_cmpge_ps(v, other.v); }
+	LaneMask<float> operator==(const ScalarLanes& other) const { return _mm_cmpeq_ps(v, other.v); }
+	LaneMask<float> operator!=(const ScalarLanes& other) const { return _mm_cmpneq_ps(v, other.v); }
+
+	ScalarLanes sqrt() const { return _mm_sqrt_ps(v); }
+	float sum() const {
+		float lanes[LANES];
+		store(lanes);
+		return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	}
+	int signBits() const { return _mm_movemask_ps(v); }
+	static ScalarLanes select(const LaneMask<float>& mask, const ScalarLanes& a, const ScalarLanes& b) {
+		return _mm_or_ps(_mm_and_ps(mask.m, a.v), _mm_andnot_ps(mask.m, b.v));
+	}
+};
+
+#elif defined(VS_LANES_AVX)
+
+/*
+* AVX, 4 doubles per register.
+*/
+template <>
+class LaneMask<double> {
+public:
+	static const int LANES = 4;
+	__m256d m;
+	LaneMask() {}
+	LaneMask(__m256d mask) : m(mask) {}
+	int bits() const { return _mm256_movemask_pd(m); }
+	LaneMask operator&(const LaneMask& other) const { return _mm256_and_pd(m, other.m); }
+	LaneMask operator|(const LaneMask& other) const { return _mm256_or_pd(m, other.m); }
+	LaneMask operator!() const { return _mm256_xor_pd(m, _mm256_castsi256_pd(_mm256_set1_epi64x(-1))); }
+};
+
+template <>
+class ScalarLanes<double> {
+public:
+	static const int LANES = 4;
+	__m256d v;
+	ScalarLanes() : v(_mm256_setzero_pd()) {}
+	ScalarLanes(double s) : v(_mm256_set1_pd(s)) {}
+	ScalarLanes(__m256d value) : v(value) {}
+	static ScalarLanes load(const double* p) { return _mm256_loadu_pd(p); }
+	void store(double* p) const { _mm256_storeu_pd(p, v); }
+
+	ScalarLanes operator+(const ScalarLanes& other) const { return _mm256_add_pd(v, other.v); }
+	ScalarLanes operator-(const ScalarLanes& other) const { return _mm256_sub_pd(v, other.v); }
+	ScalarLanes operator*(const ScalarLanes& other) const { return _mm256_mul_pd(v, other.v); }
+	ScalarLanes operator/(const ScalarLanes& other) const { return _mm256_div_pd(v, other.v); }
+	LaneMask<double> operator<(const ScalarLanes& other) const { return _mm256_cmp_pd(v, other.v, _CMP_LT_OQ); }
+	LaneMask<double> operator<=(const ScalarLanes& other) const { return _mm256_cmp_pd(v, other.v, _CMP_LE_OQ); }
+	LaneMask<double> operator>(const ScalarLanes& other) const { return _mm256_cmp_pd(v, other.v, _CMP_GT_OQ); }
+	LaneMask<double> operator>=(const ScalarLanes& other) const { return _mm256_cmp_pd(v, other.v, _CMP_GE_OQ); }
+	LaneMask<double> operator==(const ScalarLanes& other) const { return _mm256_cmp_pd(v, other.v, _CMP_EQ_OQ); }
+	LaneMask<double> operator!=(const ScalarLanes& other) const { return _mm256_cmp_pd(v, other.v, _CMP_NEQ_UQ); }
+
+	ScalarLanes sqrt() const { return _mm256_sqrt_pd(v); }
+	double sum() const {
+		double lanes[LANES];
+		store(lanes);
+		return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	}
+	int signBits() const { return _mm256_movemask_pd(v); }
+	static ScalarLanes select(const LaneMask<double>& mask, const ScalarLanes& a, const ScalarLanes& b) {
+		return _mm256_blendv_pd(b.v, a.v, mask.m);
+	}
+};
+
+/*
+* AVX, 8 floats per register.
+*/
+template <>
+class LaneMask<float> {
+public:
+	static const int LANES = 8;
+	__m256 m;
+	LaneMask() {}
+	LaneMask(__m256 mask) : m(mask) {}
+	int bits() const { return _mm256_movemask_ps(m); }
+	LaneMask operator&(const LaneMask& other) const { return _mm256_and_ps(m, other.m); }
+	LaneMask operator|(const LaneMask& other) const { return _mm256_or_ps(m, other.m); }
+	LaneMask operator!() const { return _mm256_xor_ps(m, _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+};
+
+template <>
+class ScalarLanes<float> {
+public:
+	static const int LANES = 8;
+	__m256 v;
+	ScalarLanes() : v(_mm256_setzero_ps()) {}
+	ScalarLanes(float s) : v(_mm256_set1_ps(s)) {}
+	ScalarLanes(__m256 value) : v(value) {}
+	static ScalarLanes load(const float* p) { return _mm256_loadu_ps(p); }
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+	ScalarLanes operator+(const ScalarLanes& other) const { return _mm256_add_ps(v, other.v); }
+	ScalarLanes operator-(const ScalarLanes& other) const { return _mm256_sub_ps(v, other.v); }
+	ScalarLanes operator*(const ScalarLanes& other) const { return _mm256_mul_ps(v, other.v); }
+	ScalarLanes operator/(const ScalarLanes& other) const { return _mm256_div_ps(v, other.v); }
+	LaneMask<float> operator<(const ScalarLanes& other) const { return _mm256_cmp_ps(v, other.v, _CMP_LT_OQ); }
+	LaneMask<float> operator<=(const ScalarLanes& other) const { return _mm256_cmp_ps(v, other.v, _CMP_LE_OQ); }
+	LaneMask<float> operator>(const ScalarLanes& other) const { return _mm256_cmp_ps(v, other.v, _CMP_GT_OQ); }
+	LaneMask<float> operator>=(const ScalarLanes& other) const { return _mm256_cmp_ps(v, other.v, _CMP_GE_OQ); }
+	LaneMask<float> operator==(const ScalarLanes& other) const { return _mm256_cmp_ps(v, other.v, _CMP_EQ_OQ); }
+	LaneMask<float> operator!=(const ScalarLanes& other) const { return _mm256_cmp_ps(v, other.v, _CMP_NEQ_UQ); }
+
+	ScalarLanes sqrt() const { return _mm256_sqrt_ps(v); }
+	float sum() const {
+		float lanes[LANES];
+		store(lanes);
+		return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+	}
+	int signBits() const { return _mm256_movemask_ps(v); }
+	static ScalarLanes select(const LaneMask<float>& mask, const ScalarLanes& a, const ScalarLanes& b) {
+		return _mm256_blendv_ps(b.v, a.v, mask.m);
+	}
+};
+
+#endif
+
+/*
+* LANES two-dimensional vectors, the packed companion of Vec2.
+* The operations match Vec2's but are evaluated straight away, a pack is already the unit of work.
+*/
+template <typename T>
+class Vec2Lanes {
+public:
+	typedef ScalarLanes<T> Lanes;
+	typedef LaneMask<T> Mask;
+	static const int LANES = Lanes::LANES;
+	Lanes x; Lanes y;
+
+	Vec2Lanes() {}
+	Vec2Lanes(const Lanes& x1, const Lanes& y1) : x(x1), y(y1) {}
+	// the same vector in every lane
+	explicit Vec2Lanes(const Vec2<T>& vect) : x(vect.x), y(vect.y) {}
+	static Vec2Lanes load(const T* xs, const T* ys) {
+		return Vec2Lanes(Lanes::load(xs), Lanes::load(ys));
+	}
+
+	Vec2Lanes operator+(const Vec2Lanes& vect) const { return Vec2Lanes(x + vect.x, y + vect.y); }
+	Vec2Lanes operator-(const Vec2Lanes& vect) const { return Vec2Lanes(x - vect.x, y - vect.y); }
+	Vec2Lanes operator*(const Lanes& scalar) const { return Vec2Lanes(x * scalar, y * scalar); }
+	Vec2Lanes operator*(T scalar) const { return *this * Lanes(scalar); }
+
+	Lanes dot(const Vec2Lanes& vect) const { return (x * vect.x) + (y * vect.y); }
+	Lanes magnitudeSquared() const { return dot(*this); }
+	Lanes magnitude() const { return magnitudeSquared().sqrt(); }
+	Vec2Lanes normalize() const { return *this * (Lanes(T(1)) / magnitude()); }
+	Vec2Lanes proj(const Vec2Lanes& a) const { // project these vectors onto a
+		return a * (a.dot(*this) * (Lanes(T(1)) / a.magnitudeSquared()));
+	}
+	// sum of every lane's vector
+	Vec2<T> sum() const { return Vec2<T>(x.sum(), y.sum()); }
+	// picks a where mask is set, b elsewhere
+	static Vec2Lanes select(const Mask& mask, const Vec2Lanes& a, const Vec2Lanes& b) {
+		return Vec2Lanes(Lanes::select(mask, a.x, b.x), Lanes::select(mask, a.y, b.y));
+	}
+};
+
+typedef ScalarLanes<simScalar> SimLanes;
+typedef Vec2Lanes<simScalar> Vector2DLanes;
@@ -0,0 +1,222 @@
+#include "Background.h"
+#include "Profiler.h"
+#include "SeedHash.h"
+
+#include <algorithm>
+#include <math.h>
+
+static const double NEBULACELL = 384; // layer units between the nebula's random values at its coarsest
+static const int NEBULAOCTAVES = 3;
+
+// A random value in [0, 1] at a lattice point, smoothly interpolated in between.
+static double valueNoise(int seed, int layer, double x, double y) {
+	double cellX = floor(x); double cellY = floor(y);
+	double fx = x - cellX; double fy = y - cellY;
+	fx = fx * fx * (3 - 2 * fx);
+	fy = fy * fy * (3 - 2 * fy);
+	int ix = (int)cellX; int iy = (int)cellY;
+	double v00 = seedHash(seed, layer, ix, iy) / 4294967295.0;
+	double v10 = seedHash(seed, layer, ix + 1, iy) / 4294967295.0;
+	double v01 = seedHash(seed, layer, ix, iy + 1) / 4294967295.0;
+	double v11 = seedHash(seed, layer, ix + 1, iy + 1) / 4294967295.0;
+	double top = v00 + (v10 - v00) * fx;
+	double bottom = v01 + (v11 - v01) * fx;
+	return top + (bottom - top) * fy;
+}
+
+static void putPixel(Uint32& pixel, int r, int g, int b, int a) {
+	Uint8* bytes = (Uint8*)&pixel; // SDL_PIXELFORMAT_RGBA32 is in byte order
+	bytes[0] = (Uint8)r; bytes[1] = (Uint8)g; bytes[2] = (Uint8)b; bytes[3] = (Uint8)a;
+}
+
+long long BackgroundCache::tileKey(int layer, int tileX, int tileY) {
+	return ((long long)layer << 58) ^ ((long long)(tileX & 0x1FFFFFFF) << 29) ^ (long long)(tileY & 0x1FFFFFFF);
+}
+
+void BackgroundCache::setSeed(int newSeed) {
+	if (newSeed != seed) {
+		clear();
+	}
+	seed = newSeed;
+}
+
+// Clouds from a few octaves of value noise, in two colours picked by the seed.
+// The texture holds one more texel than the tile so neighbouring tiles share their edge values and filter seamlessly.
+void BackgroundCache::fillNebula(int layer, int tileX, int tileY) {
+	const BackgroundLayer& spec = BGLAYERS[layer];
+	const int size = spec.texels + 1;
+	const double step = (double)spec.tileSize / spec.texels;
+	static const int palette[4][6] = {
+		{ 40, 20, 90, 20, 70, 120 },
+		{ 90, 20, 60, 30, 30, 100 },
+		{ 20, 60, 80, 60, 20, 90 },
+		{ 70, 40, 20, 80, 20, 60 },
+	};
+	const int* colors = palette[seedHash(seed, layer, 0, 0) % 4];
+
+	for (int py = 0; py < size; py++) {
+		for (int px = 0; px < size; px++) {
+			double x = (tileX * spec.tileSize + px * step) / NEBULACELL;
+			double y = (tileY * spec.tileSize + py * step) / NEBULACELL;
+			double density = 0; double amplitude = 0.5;
+			for (int octave = 0; octave < NEBULAOCTAVES; octave++) {
+				density += valueNoise(seed, layer * 8 + octave, x, y) * amplitude;
+				x *= 2; y *= 2; amplitude *= 0.5;
+			}
+			double mix = valueNoise(seed, layer * 8 + NEBULAOCTAVES, x / 16, y / 16);
+			// only the thicker parts show, faded in so there are no edges
+			double alpha = fmax(0, fmin(1, (density - 0.38) * 2.5));
+			alpha = alpha * alpha * 150;
+			putPixel(pixels[py * size + px],
+				(int)(colors[0] + (colors[3] - colors[0]) * mix),
+				(int)(colors[1] + (colors[4] - colors[1]) * mix),
+				(int)(colors[2] + (colors[5] - colors[2]) * mix),
+				(int)alpha);
+		}
+	}
+}
+
+// Scattered stars, a few of them larger. Kept off the edges so none are cut in half by the next tile.
+void BackgroundCache::fillStars(int layer, int tileX, int tileY) {
+	const BackgroundLayer& spec = BGLAYERS[layer];
+	const int size = spec.texels;
+	std::fill(pixels.begin(), pixels.begin() + size * size, 0);
+	Uint32 state = seedHash(seed, layer, tileX, tileY);
+	auto next = [&state]() {
+		state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+		return state;
+	};
+	const int brightest = 120 + 135 * layer / (BGLAYERCOUNT - 1); // nearer layers are brighter
+
+	for (int i = 0; i < spec.starsPerTile; i++) {
+		int x = 1 + next() % (size - 3);
+		int y = 1 + next() % (size - 3);
+		int brightness = brightest / 3 + next() % (brightest - brightest / 3 + 1);
+		int r = brightness; int g = brightness; int b = brightness;
+		switch (next() % 4)
+		{
+		case 0: // blue
+			r = r * 3 / 4;
+			break;
+		case 1: // yellow
+			b = b * 3 / 4;
+			break;
+		default:
+			break;
+		}
+		putPixel(pixels[y * size + x], r, g, b, 255);
+		if (next() % 10 == 0) {
+			putPixel(pixels[y * size + x + 1], r, g, b, 160);
+			putPixel(pixels[(y + 1) * size + x], r, g, b, 160);
+			putPixel(pixels[(y + 1) * size + x + 1], r, g, b, 100);
+		}
+	}
+}
+
+// Makes the texture for a tile, reusing one from a dropped tile of the same layer if there is one.
+SDL_Texture* BackgroundCache::generate(SDL_Renderer* renderer, int layer, int tileX, int tileY) {
+	const BackgroundLayer& spec = BGLAYERS[layer];
+	const int size = spec.nebula ? spec.texels + 1 : spec.texels;
+	SDL_Texture* texture;
+	if (!spare[layer].empty()) {
+		texture = spare[layer].back();
+		spare[layer].pop_back();
+	}
+	else {
+		texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, size, size);
+		if (texture == nullptr) {
+			return nullptr;
+		}
+		SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+		SDL_SetTextureScaleMode(texture, spec.nebula ? SDL_SCALEMODE_LINEAR : SDL_SCALEMODE_NEAREST);
+	}
+
+	if ((int)pixels.size() < size * size) {
+		pixels.resize(size * size);
+	}
+	if (spec.nebula) {
+		fillNebula(layer, tileX, tileY);
+	}
+	else {
+		fillStars(layer, tileX, tileY);
+	}
+	SDL_UpdateTexture(texture, NULL, pixels.data(), size * (int)sizeof(Uint32));
+	return texture;
+}
+
+// Drops the least recently used tiles until keep are left, never one drawn this frame.
+void BackgroundCache::evict(int keep) {
+	if ((int)tiles.size() <= keep) {
+		return;
+	}
+	std::vector<std::pair<Uint64, long long>> byAge;
+	byAge.reserve(tiles.size());
+	for (auto& entry : tiles) {
+		byAge.push_back(std::make_pair(entry.second.lastUsedFrame, entry.first));
+	}
+	std::sort(byAge.begin(), byAge.end());
+	int excess = (int)tiles.size() - keep;
+	for (int i = 0; i < excess and byAge[i].first < frame; i++) {
+		auto found = tiles.find(byAge[i].second);
+		spare[found->second.layer].push_back(found->second.texture);
+		tiles.erase(found);
+	}
+}
+
+void BackgroundCache::draw(SDL_Renderer* renderer, double left, double top, float viewWidth, float viewHeight) {
+	PROFILE_ZONE("BackgroundCache::draw");
+	frame++;
+	generatedThisFrame = 0;
+	int visible = 0;
+
+	for (int layer = 0; layer < BGLAYERCOUNT; layer++) {
+		const BackgroundLayer& spec = BGLAYERS[layer];
+		double cameraX = left * spec.parallax;
+		double cameraY = top * spec.parallax;
+		int firstX = (int)floor(cameraX / spec.tileSize); int lastX = (int)floor((cameraX + viewWidth) / spec.tileSize);
+		int firstY = (int)floor(cameraY / spec.tileSize); int lastY = (int)floor((cameraY + viewHeight) / spec.tileSize);
+		// the nebula's extra texel is only there to filter against, half a texel in from each side
+		SDL_FRect source = { 0.5f, 0.5f, (float)spec.texels, (float)spec.texels };
+
+		for (int tileY = firstY; tileY <= lastY; tileY++) {
+			for (int tileX = firstX; tileX <= lastX; tileX++) {
+				long long key = tileKey(layer, tileX, tileY);
+				auto found = tiles.find(key);
+				if (found == tiles.end()) {
+					if (generatedThisFrame >= BGTILESPERFRAME) {
+						continue;
+					}
+					SDL_Texture* texture = generate(renderer, layer, tileX, tileY);
+					generatedThisFrame++;
+					if (texture == nullptr) {
+						continue;
+					}
+					Tile tile;
+					tile.texture = texture;
+					tile.layer = layer;
+					found = tiles.emplace(key, tile).first;
+				}
+				found->second.lastUsedFrame = frame;
+				visible++;
+
+				SDL_FRect destination = { (float)(tileX * spec.tileSize - cameraX), (float)(tileY * spec.tileSize - cameraY),
+					(float)spec.tileSize, (float)spec.tileSize };
+				SDL_RenderTexture(renderer, found->second.texture, spec.nebula ? &source : NULL, &destination);
+			}
+		}
+	}
+	evict(std::max(BGMAXTILES, visible * 2));
+}
+
+void BackgroundCache::clear() {
+	for (auto& entry : tiles) {
+		SDL_DestroyTexture(entry.second.texture);
+	}
+	tiles.clear();
+	for (int layer = 0; layer < BGLAYERCOUNT; layer++) {
+		for (SDL_Texture* texture : spare[layer]) {
+			SDL_DestroyTexture(texture);
+		}
+		spare[layer].clear();
+	}
+}
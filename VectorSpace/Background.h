@@ -0,0 +1,58 @@
+/*
+* The starfield and nebula drawn behind everything, made from the world seed.
+* The background is split into square tiles per parallax layer. Each tile is generated once into a texture when
+* it first comes into view, and after that a frame only copies the visible tiles. Tiles that have not been used
+* for longest are dropped as the camera moves on, their textures are kept to hold the next tiles of that layer.
+*/
+
+#pragma once
+#include <SDL3/SDL.h>
+#include <unordered_map>
+#include <vector>
+
+// One parallax layer, layers are drawn back to front.
+struct BackgroundLayer {
+	double parallax; // how far the layer moves for each unit the camera moves
+	int tileSize; // world units a tile covers on screen
+	int texels; // texture size, the nebula is smooth enough to be stretched
+	bool nebula; // clouds rather than stars
+	int starsPerTile;
+};
+
+static const BackgroundLayer BGLAYERS[] = {
+	{ 0.05, 1024, 64, true, 0 },
+	{ 0.15, 256, 256, false, 20 },
+	{ 0.35, 256, 256, false, 6 },
+};
+static const int BGLAYERCOUNT = sizeof(BGLAYERS) / sizeof(BGLAYERS[0]);
+static const int BGMAXTILES = 96; // tiles kept before the least recently used are dropped, raised when more are in view
+static const int BGTILESPERFRAME = 8; // tiles generated per frame at most, the rest fill in over the next frames
+
+class BackgroundCache {
+private:
+	struct Tile {
+		SDL_Texture* texture = nullptr;
+		int layer = 0;
+		Uint64 lastUsedFrame = 0;
+	};
+	std::unordered_map<long long, Tile> tiles; // by tileKey
+	std::vector<SDL_Texture*> spare[BGLAYERCOUNT]; // from dropped tiles
+	std::vector<Uint32> pixels; // generation scratch
+	int seed = 0;
+	Uint64 frame = 0;
+	int generatedThisFrame = 0;
+
+	static long long tileKey(int layer, int tileX, int tileY);
+	SDL_Texture* generate(SDL_Renderer* renderer, int layer, int tileX, int tileY);
+	void fillNebula(int layer, int tileX, int tileY);
+	void fillStars(int layer, int tileX, int tileY);
+	void evict(int keep);
+public:
+	~BackgroundCache() { clear(); }
+	// Starts over for a new world, tiles from the old seed are dropped.
+	void setSeed(int newSeed);
+	// Draws every layer for a view whose top left corner is at (left, top) in world units.
+	void draw(SDL_Renderer* renderer, double left, double top, float viewWidth, float viewHeight);
+	void clear();
+	int cachedTiles() { return (int)tiles.size(); }
+};
@@ -0,0 +1,384 @@
+#include "Batch.h"
+#include "AllocTracker.h"
+#include "Simulation.h"
+#include "WorkerPool.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+struct BatchOptions {
+	int seeds = BATCHSEEDS;
+	int firstSeed = 1;
+	double hours = BATCHHOURS;
+	double deltaT = BATCHDELTAT;
+	int threads = 0; // 0 for every core
+	bool json = false;
+	const char* outPath = nullptr; // stdout when not given
+	bool allocTest = false;
+	bool genTest = false;
+};
+
+// Swallows everything written to it. The game logs to std::cout as it goes, with worlds on every core that would
+// bury the results, and unlike a null rdbuf writing here does not touch the stream's state from many threads.
+class DiscardBuffer : public std::streambuf {
+protected:
+	int overflow(int c) override { return c; }
+	std::streamsize xsputn(const char* s, std::streamsize n) override { return n; }
+};
+
+// The world the current thread is ticking, for countEvent.
+static thread_local WorldSummary* currentSummary = nullptr;
+
+static void countEvent(const GameEvent& event, GameState* state) {
+	WorldSummary* summary = currentSummary;
+	switch (event.type)
+	{
+	case GameEvent::Kill:
+		if (event.isPlayer) {
+			summary->playerDeaths++;
+		}
+		else if (state->entities.faction(event.entity) == 'e') { // still in its archetype until the cleaner runs
+			summary->piratesLost++;
+		}
+		else {
+			summary->cargoShipsLost++;
+		}
+		break;
+	case GameEvent::CargoDelivered:
+		summary->deliveries++;
+		summary->cargoDelivered += event.amount;
+		break;
+	case GameEvent::CityFull:
+		summary->cityFullEvents++;
+		break;
+	default:
+		break;
+	}
+}
+
+static void sampleCities(GameState* state, WorldSummary& summary) {
+	if (state->cities.empty()) {
+		return;
+	}
+	int full = 0;
+	double fill = 0;
+	for (City* city : state->cities) {
+		float storage = city->getCurStorage(state->worldTime);
+		if (storage >= city->getStorageLimit()) {
+			full++;
+		}
+		fill += storage / city->getStorageLimit();
+	}
+	// running averages so nothing grows with the length of the run
+	summary.citySamples++;
+	summary.citySaturation += ((double)full / state->cities.size() - summary.citySaturation) / summary.citySamples;
+	summary.cityFill += (fill / state->cities.size() - summary.cityFill) / summary.citySamples;
+}
+
+// Builds the world for seed the way the menu does, with the player holding station at the origin.
+// The batch runs and the alloc test both start from here so the test covers the worlds the batch runs.
+static GameState* makeBatchWorld(int seed) {
+	GameState* state = makeHeadlessWorld(seed);
+	state->player = new PlayerShip();
+	state->player->doBrake(); // holds station instead of falling into the nearest star
+	state->ai.budgetMicros = 0; // every entity thinks every tick, a budget in wall time would change a seed's results run to run
+	generatePlaySpace(1000, 500, seed, state);
+	state->spatialIndex.rebuild(state);
+	return state;
+}
+
+// Ticks the world for seed for the whole run.
+static void runWorld(int seed, const BatchOptions& options, WorldSummary& summary) {
+	auto start = std::chrono::steady_clock::now();
+	summary.seed = seed;
+	currentSummary = &summary;
+
+	GameState* state = makeBatchWorld(seed);
+	state->events.subscribe(countEvent);
+	summary.cities = (int)state->cities.size();
+
+	long long ticks = (long long)(options.hours * 3600 / options.deltaT);
+	long long samplePeriod = (long long)(BATCHSAMPLEPERIOD / options.deltaT);
+	if (samplePeriod < 1) {
+		samplePeriod = 1;
+	}
+	for (long long tick = 0; tick < ticks; tick++) {
+		state->deltaT = (float)options.deltaT;
+		update(state, 0);
+		if (state->resetFlag) {
+			// only the player died, the world carries on
+			state->resetFlag = false;
+			state->player->resetPlayer();
+		}
+		if (tick % samplePeriod == 0) {
+			sampleCities(state, summary);
+		}
+	}
+	summary.ticks = ticks;
+	summary.simSeconds = ticks * options.deltaT;
+
+	resetGameState(state);
+	delete state->player;
+	delete state;
+	currentSummary = nullptr;
+	summary.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Ticks one world with the player shooting until it settles, then fails if any later tick allocates.
+// Returns the process exit code.
+static int runAllocTest(const BatchOptions& options) {
+	GameState* state = makeBatchWorld(options.firstSeed);
+
+	long long warmupTicks = (long long)(ALLOCTESTWARMUP / options.deltaT);
+	long long testTicks = (long long)(ALLOCTESTSECONDS / options.deltaT);
+	long long allocatingTicks = 0;
+	long long firstTick = -1;
+	AllocCounts total;
+	for (long long tick = 0; tick < warmupTicks + testTicks; tick++) {
+		state->deltaT = (float)options.deltaT;
+		AllocCounts before = AllocTracker::thisThread();
+		update(state, HeldUp); // shooting keeps the projectiles coming and going
+		if (state->resetFlag) {
+			state->resetFlag = false;
+			state->player->resetPlayer();
+		}
+		AllocCounts after = AllocTracker::thisThread();
+#ifdef VS_PROFILE
+		Profiler::endFrame(); // per zone allocations for the report below
+#endif
+		if (tick < warmupTicks or after.count == before.count) {
+			continue;
+		}
+		allocatingTicks++;
+		total.count += after.count - before.count;
+		total.bytes += after.bytes - before.bytes;
+		if (firstTick == -1) {
+			firstTick = tick - warmupTicks;
+#ifdef VS_PROFILE
+			std::vector<ZoneStats> stats;
+			Profiler::getStats(stats);
+			for (ZoneStats& zone : stats) {
+				if (zone.lastAllocations > 0) {
+					std::cerr << "  " << zone.name << ": " << zone.lastAllocations << " allocations, " << zone.lastAllocatedBytes << " bytes\n";
+				}
+			}
+#endif
+		}
+	}
+
+	resetGameState(state);
+	delete state->player;
+	delete state;
+	if (allocatingTicks > 0) {
+		std::cerr << "alloc test failed: " << allocatingTicks << " of " << testTicks << " steady-state ticks allocated, "
+			<< total.count << " allocations and " << total.bytes << " bytes, the first " << firstTick << " ticks in\n";
+		return 1;
+	}
+	std::cerr << "alloc test passed: no allocations in " << testTicks << " steady-state ticks\n";
+	return 0;
+}
+
+// Tells where two worlds built from the same seed first differ in their body order or random state, or returns
+// nullptr if they do not.
+static const char* firstDifference(GameState* a, GameState* b) {
+	if (a->staticGravBodies.size() != b->staticGravBodies.size() or a->dynamicGravBodies.size() != b->dynamicGravBodies.size()) {
+		return "body counts";
+	}
+	for (int i = 0; i < (int)a->staticGravBodies.size(); i++) {
+		StaticGravBody* x = a->staticGravBodies[i]; StaticGravBody* y = b->staticGravBodies[i];
+		if (!(x->location == y->location) or x->mass != y->mass or x->radius != y->radius or y->bodyID != i) {
+			return "static body order";
+		}
+	}
+	for (int i = 0; i < (int)a->dynamicGravBodies.size(); i++) {
+		DynamicGravBody* x = a->dynamicGravBodies[i]; DynamicGravBody* y = b->dynamicGravBodies[i];
+		if (!(x->location == y->location) or x->mass != y->mass or x->radius != y->radius or y->bodyID != i) {
+			return "dynamic body order";
+		}
+	}
+	if (a->cities.size() != b->cities.size()) {
+		return "city counts";
+	}
+	for (int i = 0; i < (int)a->cities.size(); i++) {
+		if (a->cities[i]->getTiedBody()->bodyID != b->cities[i]->getTiedBody()->bodyID) {
+			return "city bodies";
+		}
+	}
+	WorldRandom randomA = a->random; WorldRandom randomB = b->random;
+	for (int i = 0; i < 8; i++) {
+		if (randomA.next() != randomB.next()) {
+			return "random state";
+		}
+	}
+	return nullptr;
+}
+
+// Builds every seed with generatePlaySpace and with the background generator taken in to the end, and fails if any
+// pair differs. Returns the process exit code.
+static int runGenTest(const BatchOptions& options) {
+	int failed = 0;
+	for (int i = 0; i < options.seeds; i++) {
+		int seed = options.firstSeed + i * BATCHSEEDSTEP;
+		GameState* direct = makeHeadlessWorld(seed);
+		generatePlaySpace(1000, 500, seed, direct);
+		GameState* adopted = makeHeadlessWorld(seed);
+		startWorldGeneration(1000, 500, seed, adopted);
+		while (!adoptGeneratedWorld(adopted)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		const char* difference = firstDifference(direct, adopted);
+		if (difference != nullptr) {
+			std::cerr << "seed " << seed << ": the background world differs in its " << difference << "\n";
+			failed++;
+		}
+		resetGameState(direct);
+		resetGameState(adopted);
+		delete direct;
+		delete adopted;
+	}
+	if (failed > 0) {
+		std::cerr << "gen test failed: " << failed << " of " << options.seeds << " seeds built a different world in the background\n";
+		return 1;
+	}
+	std::cerr << "gen test passed: " << options.seeds << " seeds built the same world in the background\n";
+	return 0;
+}
+
+static void writeHeader(std::ostream& out, bool json) {
+	if (json) {
+		out << "{\"worlds\":[\n";
+	}
+	else {
+		out << "seed,ticks,sim_seconds,wall_seconds,cities,deliveries,cargo_delivered,cargo_per_hour,"
+			"city_full_events,city_saturation,city_fill,cargo_ships_lost,pirates_lost,player_deaths\n";
+	}
+}
+
+static void writeSummary(std::ostream& out, bool json, bool first, const WorldSummary& s) {
+	double cargoPerHour = s.simSeconds > 0 ? s.cargoDelivered / (s.simSeconds / 3600) : 0;
+	if (json) {
+		out << (first ? "" : ",\n") << "{\"seed\":" << s.seed << ",\"ticks\":" << s.ticks << ",\"sim_seconds\":" << s.simSeconds
+			<< ",\"wall_seconds\":" << s.wallSeconds << ",\"cities\":" << s.cities << ",\"deliveries\":" << s.deliveries
+			<< ",\"cargo_delivered\":" << s.cargoDelivered << ",\"cargo_per_hour\":" << cargoPerHour
+			<< ",\"city_full_events\":" << s.cityFullEvents << ",\"city_saturation\":" << s.citySaturation
+			<< ",\"city_fill\":" << s.cityFill << ",\"cargo_ships_lost\":" << s.cargoShipsLost
+			<< ",\"pirates_lost\":" << s.piratesLost << ",\"player_deaths\":" << s.playerDeaths << "}";
+	}
+	else {
+		out << s.seed << "," << s.ticks << "," << s.simSeconds << "," << s.wallSeconds << "," << s.cities << ","
+			<< s.deliveries << "," << s.cargoDelivered << "," << cargoPerHour << "," << s.cityFullEvents << ","
+			<< s.citySaturation << "," << s.cityFill << "," << s.cargoShipsLost << "," << s.piratesLost << ","
+			<< s.playerDeaths << "\n";
+	}
+	out.flush();
+}
+
+bool isBatchCommand(int argc, char* argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--batch") == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Runs every seed and writes a line per world as each finishes, then the throughput to stderr.
+// Returns the process exit code.
+int runBatch(int argc, char* argv[]) {
+	BatchOptions options;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0) {
+			options.json = true;
+		}
+		else if (strcmp(argv[i], "--alloc-test") == 0) {
+			options.allocTest = true;
+		}
+		else if (strcmp(argv[i], "--gen-test") == 0) {
+			options.genTest = true;
+		}
+		else if (strcmp(argv[i], "--seeds") == 0 and i + 1 < argc) {
+			options.seeds = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--first-seed") == 0 and i + 1 < argc) {
+			options.firstSeed = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--hours") == 0 and i + 1 < argc) {
+			options.hours = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--dt") == 0 and i + 1 < argc) {
+			options.deltaT = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--threads") == 0 and i + 1 < argc) {
+			options.threads = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--out") == 0 and i + 1 < argc) {
+			options.outPath = argv[++i];
+		}
+	}
+	if (options.seeds < 1 or options.hours <= 0 or options.deltaT <= 0) {
+		std::cerr << "--batch needs at least one seed, a positive --hours and a positive --dt\n";
+		return 1;
+	}
+	int threads = options.threads > 0 ? options.threads : (int)std::thread::hardware_concurrency();
+	if (threads < 1) {
+		threads = 1;
+	}
+	if (threads > options.seeds) {
+		threads = options.seeds;
+	}
+
+	DiscardBuffer discard;
+	std::streambuf* console = std::cout.rdbuf(&discard);
+	std::ofstream file;
+	if (options.outPath != nullptr) {
+		file.open(options.outPath);
+		if (!file) {
+			std::cout.rdbuf(console);
+			std::cerr << "could not open " << options.outPath << "\n";
+			return 1;
+		}
+	}
+	std::ostream out(options.outPath != nullptr ? file.rdbuf() : console);
+	if (options.allocTest) {
+		int result = runAllocTest(options);
+		std::cout.rdbuf(console);
+		return result;
+	}
+	if (options.genTest) {
+		int result = runGenTest(options);
+		std::cout.rdbuf(console);
+		return result;
+	}
+	std::cerr << "running " << options.seeds << " worlds for " << options.hours << " hours each on " << threads << " threads\n";
+
+	std::mutex outLock;
+	bool first = true;
+	long long totalTicks = 0;
+	writeHeader(out, options.json);
+	auto start = std::chrono::steady_clock::now();
+
+	WorkerPool pool;
+	pool.start(threads - 1);
+	pool.run(options.seeds, [&](int task, int worker) {
+		WorldSummary summary;
+		runWorld(options.firstSeed + task * BATCHSEEDSTEP, options, summary);
+		std::lock_guard<std::mutex> guard(outLock);
+		writeSummary(out, options.json, first, summary);
+		first = false;
+		totalTicks += summary.ticks;
+	});
+	pool.stop();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	double ticksPerSecond = totalTicks / seconds;
+	if (options.json) {
+		out << "\n],\"world_ticks\":" << totalTicks << ",\"wall_seconds\":" << seconds << ",\"world_ticks_per_second\":" << ticksPerSecond << "}\n";
+	}
+	out.flush();
+	std::cout.rdbuf(console);
+	std::cerr << totalTicks << " world ticks in " << seconds << " s, " << ticksPerSecond << " world ticks per second\n";
+	return 0;
+}
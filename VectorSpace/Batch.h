@@ -0,0 +1,47 @@
+/*
+* Headless batch runs for balancing.
+* Many worlds, each generated from its own seed and ticked at a fixed timestep with no window, are spread over
+* every core one world per task. Each world's summary is written out as soon as it finishes.
+*
+* Usage: VectorSpace --batch [--seeds N] [--first-seed S] [--hours H] [--dt seconds] [--threads N] [--json] [--out path]
+* World i is generated from first-seed + i * BATCHSEEDSTEP.
+*
+* VectorSpace --batch --alloc-test [--first-seed S] [--dt seconds] instead ticks one world until it has settled and
+* exits with 1 if any tick after that allocates, see AllocTracker.h.
+*
+* VectorSpace --batch --gen-test [--seeds N] [--first-seed S] builds each world with generatePlaySpace and with the
+* background generator, see WorldGen.h, and exits with 1 if any differ in body order or random state.
+*/
+
+#pragma once
+
+static const int BATCHSEEDS = 64; // worlds run when --seeds is not given
+static const double BATCHHOURS = 1; // simulated hours per world when --hours is not given
+static const double BATCHDELTAT = 1.0 / 144; // the fixed timestep, the same as the game's tick rate
+static const double BATCHSAMPLEPERIOD = 1; // simulated seconds between city samples
+static const int BATCHSEEDSTEP = 1000; // between worlds, generatePlaySpace uses a run of seeds so close ones share systems
+static const double ALLOCTESTWARMUP = 30; // simulated seconds for the containers to reach their working sizes
+static const double ALLOCTESTSECONDS = 60; // simulated seconds that must not allocate
+
+// What one world did over its run, the kills and deliveries are counted from its events.
+struct WorldSummary {
+	int seed = 0;
+	long long ticks = 0;
+	double simSeconds = 0;
+	double wallSeconds = 0;
+	int cities = 0;
+	int deliveries = 0;
+	double cargoDelivered = 0;
+	int cityFullEvents = 0;
+	double citySaturation = 0; // average share of cities at their storage limit
+	double cityFill = 0; // average share of storage in use over every city
+	int citySamples = 0;
+	int cargoShipsLost = 0;
+	int piratesLost = 0;
+	int playerDeaths = 0; // the player ship brakes at the origin for the pirates to hunt and respawns there,
+	// planets orbiting through the origin kill it too
+};
+
+// See Batch.cpp for descriptions.
+bool isBatchCommand(int argc, char* argv[]);
+int runBatch(int argc, char* argv[]);
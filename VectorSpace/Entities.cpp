@@ -0,0 +1,506 @@
+#include "Entities.h"
+#include "GameData.h"
+#include "Sectors.h"
+
+// Navigation
+
+// Finds the closest body in the way to destination and sets currentDest to go around it.
+void avoidBodies(GameState* state, Navigation& nav, Vector2D location) {
+	PROFILE_ZONE("avoidBodies");
+	// Body Avoidance
+	// draw a line from location to destination. if a body intersects the line add a vertex away from it as a temp destination
+	// check to see if a body intersects by projecting the distance and seeing if that point is within the body radius
+	/*
+				Body
+			   /  '
+	dVect ->  /   '
+			 /    ' <- C -> B (distB)
+			/     '
+		   /	  '
+		  A ------------------ B <- line from location to destination (lineVect)
+		  A ----- C <- projection of A -> Body onto A -> B (lineVecrProj)
+	*/
+	nav.currentDest = nav.destination;
+	double closestDist = -1;
+	nav.closestBody = nullptr;
+
+	// Each lane pack of bodies is tested at once, the candidates are then walked in order
+	// so the closest is picked exactly as a one body at a time loop would.
+	const BodyLanes& lanes = state->bodyLanes;
+	const int width = SimLanes::LANES;
+	Vector2D lineVect = nav.destination - location;
+	Vector2D closestCBody;
+	const Vector2DLanes dest(nav.destination);
+	const Vector2DLanes here(location);
+	const Vector2DLanes line(lineVect);
+	const SimLanes lineMagnitudeSquared(lineVect.magnitudeSquared());
+	const int lineSignX = SimLanes(lineVect.x).signBits();
+	const int lineSignY = SimLanes(lineVect.y).signBits();
+	simScalar projMagnitudes[width];
+	simScalar cBodyX[width]; simScalar cBodyY[width];
+	for (int range = 0; range < 2; range++) { // static bodies then dynamic bodies
+		int begin = range == 0 ? 0 : lanes.dynamicStart;
+		int end = range == 0 ? lanes.staticEnd : lanes.dynamicEnd;
+		for (int i = begin; i < end; i += width) {
+			Vector2DLanes bodyLocation = Vector2DLanes::load(&lanes.x[i], &lanes.y[i]);
+			SimLanes radius = SimLanes::load(&lanes.radius[i]);
+
+			// if the destination is in a body, go there anyway
+			int destinationInside = ((dest - bodyLocation).magnitude() <= radius).bits();
+
+			Vector2DLanes dVect = bodyLocation - here;
+			Vector2DLanes lineVecrProj = dVect.proj(line);
+			Vector2DLanes C = lineVecrProj + here; // the location of C
+			Vector2DLanes cBody = bodyLocation - C;
+			SimLanes distB = cBody.magnitude();
+
+			// This method will consider bodies that are "Behind the body" thus those need to be passed over
+			// A body is in front if lineVecrProj and lineVect have the same normal (or the same signs for x and y)
+			int behind = (lineVecrProj.x.signBits() ^ lineSignX) & (lineVecrProj.y.signBits() ^ lineSignY);
+			// We also should not concider bodies that are further than B
+			int further = (lineVecrProj.magnitudeSquared() > lineMagnitudeSquared).bits();
+			int near = (distB <= radius + SimLanes(10)).bits();
+
+			int candidates = near & ~destinationInside & ~behind & ~further;
+			if (candidates == 0) {
+				continue;
+			}
+			lineVecrProj.magnitude().store(projMagnitudes);
+			cBody.x.store(cBodyX); cBody.y.store(cBodyY);
+			for (int lane = 0; lane < width; lane++) {
+				if ((candidates >> lane & 1) == 0) {
+					continue;
+				}
+				if (closestDist == -1 or projMagnitudes[lane] < closestDist) {
+					closestDist = projMagnitudes[lane];
+					nav.closestBody = lanes.bodies[i + lane];
+					closestCBody = Vector2D(cBodyX[lane], cBodyY[lane]);
+				}
+			}
+		}
+	}
+	if (nav.closestBody != nullptr) {
+		if (closestCBody == Vector2D(0, 0)) {
+			Vector2D avoidVect = (nav.closestBody->location - location).normalize();
+			avoidVect = Vector2D(-avoidVect.y, avoidVect.x);
+			avoidVect = avoidVect * -(nav.closestBody->radius + 60);
+			nav.currentDest = nav.closestBody->location + avoidVect;
+		}
+		else {
+			nav.currentDest = nav.closestBody->location + (closestCBody.normalize() * -(nav.closestBody->radius + 60));
+		}
+	}
+}
+
+// Moves one entity for a tick, steering to currentDest under gravity.
+// currentDest is worked out when the entity thinks, see thinkEntity.
+void navigate(GameState* state, Navigation& nav, GravityCache& gravity, Vector2D& location, Vector2D& speed) {
+	/*
+	* The current avoidance and speed system is not perfect, some collisions still happen
+	* but I feel they are reasonable.
+	*/
+	Vector2D newSpeed = speed;
+	Vector2D gravVect = (gravity.get(state, location) * state->deltaT);
+	newSpeed = newSpeed + gravVect;
+
+	// Temporary testing code just to see the object move
+	// get a random body to use for a new destination
+	if ((nav.destination - location).magnitude() < 18) {
+		int randIndex = state->random.next() % (state->staticGravBodies.size() - 1);
+		StaticGravBody* bod = state->staticGravBodies.at(randIndex);
+		Vector2D pVect = Vector2D(state->random.next(), state->random.next());
+		pVect = pVect.normalize();
+		pVect = pVect * (bod->radius + 100);
+		pVect = pVect + bod->location;
+
+		nav.start = nav.destination;
+		nav.destination = pVect;
+		nav.currentDest = pVect; // until the next think goes around what is in the way
+	}
+
+	nav.impulseSpeed = 20;
+	Vector2D locationAsIs = location + (newSpeed * state->deltaT);
+	// if moving forward is worse thank brakeing
+	Vector2D locationWithBrake = location + ((newSpeed * 0.9) * state->deltaT);
+	if ((nav.currentDest - locationAsIs).cmpMag(nav.currentDest - locationWithBrake)) {
+		newSpeed = newSpeed * 0.9;
+	}
+
+	// if the current speed gets close to currentDest do not add an impulse to speed
+	Vector2D speedWithImpulse = newSpeed + ((nav.currentDest - location).normalize() * nav.impulseSpeed);
+	Vector2D locationWithImpulse = location + (speedWithImpulse * state->deltaT);
+	if ((nav.currentDest - locationAsIs).cmpMag(nav.currentDest - locationWithImpulse)) { // is the locationAsIs worse than locationWithImpulse
+		newSpeed = speedWithImpulse;
+		// The limit is to prevent zigzagging
+		if (abs(newSpeed.x) < nav.impulseSpeed / 4) {
+			newSpeed.x = 0;
+		}
+		if (abs(newSpeed.y) < nav.impulseSpeed / 4) {
+			newSpeed.y = 0;
+		}
+	}
+
+	Vector2D dtSpeed = (newSpeed * state->deltaT);
+	Body* collided = willCollide(state, location + Vector2D(dtSpeed.x, dtSpeed.y));
+	if (collided != nullptr) { // A body was collided with
+		Vector2D n;
+		Vector2D relativeSpeed = newSpeed - collided->speed;
+		n = location - collided->location;
+		n = n * (1 / n.magnitude());
+
+		newSpeed = newSpeed * 0.75; // a little friction
+		double impulse = relativeSpeed.dot(n) * -(1.5);
+		newSpeed = newSpeed + (n * impulse);
+	}
+
+	// cap the new speed
+	if (newSpeed.x > 800) {
+		newSpeed.x = 800;
+	}
+	if (newSpeed.x < -800) {
+		newSpeed.x = -800;
+	}
+	if (newSpeed.y > 800) {
+		newSpeed.y = 800;
+	}
+	if (newSpeed.y < -800) {
+		newSpeed.y = -800;
+	}
+
+	speed = newSpeed;
+
+	// change location by speed
+	location = location + (speed * state->deltaT);
+
+	// past an open border SectorMap::exchange hands the entity to the next sector
+	if (location.x < -AREASIZE and !(state->openBorders & SideLeft)) {
+		location.x = -AREASIZE;
+		speed.x = 0;
+	}
+	if (location.x > AREASIZE and !(state->openBorders & SideRight)) {
+		location.x = AREASIZE;
+		speed.x = 0;
+	}
+	if (location.y < -AREASIZE and !(state->openBorders & SideTop)) {
+		location.y = -AREASIZE;
+		speed.y = 0;
+	}
+	if (location.y > AREASIZE and !(state->openBorders & SideBottom)) {
+		location.y = AREASIZE;
+		speed.y = 0;
+	}
+}
+
+// Cargo
+
+// Cities are judged by what they will hold when the ship gets there rather than what they hold now.
+static double arrivalTime(GameState* state, float distance) {
+	return state->worldTime + distance / CARGOTRIPSPEED;
+}
+
+// checks if a city has the supply to fill to cargoCap
+static City* getBestProducer(GameState* state, Vector2D location, int cargoCap) {
+	City* closest = nullptr;
+	float closestDis = -1;
+	for (City* city : state->cities) {
+		if (city->getpcPS() > 0) { // only producers
+			float distance = (location - city->getTiedBody()->location).magnitude();
+			if (city->getCurStorage(arrivalTime(state, distance)) > cargoCap) { // A trip is only worth it if the city can fill the cargo hold
+				if ((closest == nullptr) or (distance < closestDis)) {
+					closest = city;
+					closestDis = distance;
+				}
+			}
+		}
+	}
+	return closest;
+}
+static City* getBestConsumer(GameState* state, Vector2D location) {
+	City* closest = nullptr;
+	float closestDis = -1;
+	for (City* city : state->cities) {
+		if (city->getpcPS() <= 0) { // only consumers
+			float distance = (location - city->getTiedBody()->location).magnitude();
+			if (city->getCurStorage(arrivalTime(state, distance)) >= city->getStorageLimit()) {
+				continue;
+			}
+			if ((closest == nullptr) or (distance < closestDis)) {
+				closest = city;
+				closestDis = distance;
+			}
+		}
+	}
+	return closest;
+}
+
+// Sends a loaded ship over a random open border, the sector on the other side picks its consumer.
+static bool exportHold(GameState* state, CargoHold& hold, Navigation& nav, Vector2D location) {
+	if (state->openBorders == 0 or state->random.next() % 100 >= SECTOREXPORTCHANCE) {
+		return false;
+	}
+	int side = state->random.next() % 4;
+	while (!(state->openBorders & (1 << side))) {
+		side = (side + 1) % 4;
+	}
+	const double past = AREASIZE + 500;
+	switch (side)
+	{
+	case 0:
+		nav.destination = Vector2D(-past, location.y);
+		break;
+	case 1:
+		nav.destination = Vector2D(past, location.y);
+		break;
+	case 2:
+		nav.destination = Vector2D(location.x, -past);
+		break;
+	default:
+		nav.destination = Vector2D(location.x, past);
+		break;
+	}
+	hold.exporting = true;
+	return true;
+}
+
+// Picks up from producers, delivers to consumers and points a cargo ship at its next city.
+static void cargoThink(GameState* state, EntityArchetype& ships, int i) {
+	CargoHold& hold = ships.cargo[i];
+	Vector2D location = ships.location[i];
+	if (hold.exporting) {
+		return;
+	}
+	if (hold.destCity == nullptr) {
+		if (hold.cargoCount >= hold.cargoCap) {
+			hold.destCity = getBestConsumer(state, location);
+		}
+		else {
+			hold.destCity = getBestProducer(state, location, hold.cargoCap);
+		}
+	}
+	else if ((location - hold.destCity->getTiedBody()->location).magnitude() <= hold.destCity->getTiedBody()->radius + 100) { // take or supply the city if close by
+		if (hold.destCity->getpcPS() > 0) {
+			hold.cargoCount = hold.destCity->take(state, hold.cargoCap);
+			hold.destCity = nullptr;
+			if (exportHold(state, hold, ships.navigation[i], location)) {
+				return;
+			}
+			hold.destCity = getBestConsumer(state, location);
+		}
+		else {
+			float before = hold.destCity->getCurStorage(state->worldTime);
+			hold.cargoCount = hold.destCity->give(state, hold.cargoCap);
+
+			GameEvent event;
+			event.type = GameEvent::CargoDelivered;
+			event.entity = state->entities.refAt(ships.kind, i);
+			event.cityID = hold.destCity->getID();
+			event.amount = hold.destCity->getCurStorage(state->worldTime) - before;
+			event.location = location;
+			state->events.publish(event);
+
+			hold.destCity = getBestProducer(state, location, hold.cargoCap);
+		}
+	}
+
+	if (hold.destCity != nullptr) {
+		ships.navigation[i].destination = hold.destCity->getTiedBody()->location;
+	}
+}
+
+// Pirates
+
+// Sets where a pirate wants to be around the player and whether it is close enough to shoot.
+// Without a player in the sector they keep wandering to wherever navigate sends them.
+static void pirateThink(GameState* state, EntityArchetype& pirates, int i) {
+	PirateBrain& brain = pirates.brain[i];
+	if (state->player == nullptr) {
+		brain.engaged = false;
+		return;
+	}
+	Vector2D playerLocation = state->player->getLocation();
+	Vector2D location = pirates.location[i];
+	Navigation& nav = pirates.navigation[i];
+	float dfp = (location - playerLocation).magnitude();
+	Vector2D pte = (playerLocation - location).normalize(); // player to entity
+	switch (brain.behavior) {
+	case Reckless:
+		if (dfp > 100) {
+			nav.destination = playerLocation + pte * 100;
+		}
+		break;
+	case Cautious:
+		nav.destination = playerLocation - pte * 300;
+		break;
+	case Driveby:
+		nav.destination = playerLocation + rotateVector2D(pte * 300, 3.1415 / 2);
+		break;
+	}
+	brain.engaged = dfp < 500.0; // if player is close try to attack
+}
+
+// Shoots at the player from pirates that were close enough when they last thought, run after they have moved.
+static void pirateAttackSystem(GameState* state, EntityArchetype& pirates) {
+	PlayerShip* player = state->player;
+	if (player == nullptr) {
+		return;
+	}
+	for (int i = 0; i < pirates.size(); i++) {
+		if (pirates.dead[i]) {
+			continue;
+		}
+		Vector2D location = pirates.location[i];
+		PirateBrain& brain = pirates.brain[i];
+		if (brain.engaged) {
+			brain.attackTimer -= state->deltaT;
+			if (brain.attackTimer <= 0) {
+				brain.attackTimer = 0.25;
+				float lead = player->getSpeed().magnitude();
+				Vector2D locSpeed = player->getLocation() + ((player->getSpeed() * state->deltaT) * lead);
+				Vector2D dir = (locSpeed - location).normalize();
+				Vector2D projSpeed = dir * 1000;
+
+				state->projectilePool.fire(state, location, projSpeed, 16, 0.1);
+			}
+		}
+	}
+}
+
+// Sleep
+
+// Nothing to do and nobody to see it: a cargo ship with no city worth going to, or a pirate with no player near.
+static bool isIdle(GameState* state, EntityArchetype& archetype, int i) {
+	PlayerShip* player = state->player;
+	if (player != nullptr and (archetype.location[i] - player->getLocation()).magnitude() < ENTITYSLEEPRANGE) {
+		return false;
+	}
+	if (archetype.kind == KindCargo) {
+		return archetype.cargo[i].destCity == nullptr and !archetype.cargo[i].exporting;
+	}
+	return true;
+}
+
+// Puts an idle entity to sleep by the body it is resting at, returns false when no body is close enough to rest at.
+static bool fallAsleep(GameState* state, EntityArchetype& archetype, int i) {
+	Vector2D location = archetype.location[i];
+	Body* host = closestToPoint(state, location);
+	if (host == nullptr or (location - host->location).magnitude() > host->radius + ENTITYRESTRANGE) {
+		return false;
+	}
+	Sleep& sleep = archetype.sleep[i];
+	sleep.asleep = true;
+	sleep.host = host;
+	sleep.offset = location - host->location;
+	sleep.since = state->worldTime;
+	sleep.thinkAt = state->worldTime + ENTITYSLEEPCHECK;
+	archetype.speed[i] = host->speed;
+	if (archetype.kind == KindPirate) {
+		archetype.brain[i].engaged = false;
+	}
+	return true;
+}
+
+void EntityWorld::wakeNear(GameState* state, Vector2D location) {
+	nearPlayer.clear();
+	state->spatialIndex.queryEntities(WorldRect(location.x - ENTITYWAKERANGE, location.y - ENTITYWAKERANGE,
+		location.x + ENTITYWAKERANGE, location.y + ENTITYWAKERANGE), nearPlayer);
+	for (EntityRef ref : nearPlayer) {
+		if (isAlive(ref) and isAsleep(ref) and (this->location(ref) - location).magnitude() < ENTITYWAKERANGE) {
+			wake(ref);
+		}
+	}
+}
+
+// Systems
+
+static void navigationSystem(GameState* state, EntityArchetype& archetype) {
+	for (int i = 0; i < archetype.size(); i++) {
+		if (archetype.dead[i]) {
+			continue;
+		}
+		if (archetype.sleep[i].asleep) {
+			const Sleep& sleep = archetype.sleep[i];
+			archetype.location[i] = sleep.host->location + sleep.offset;
+			archetype.speed[i] = sleep.host->speed;
+			continue;
+		}
+		navigate(state, archetype.navigation[i], archetype.gravity[i], archetype.location[i], archetype.speed[i]);
+	}
+}
+
+// Makes one entity's decisions from where things are now, they are kept until it thinks again.
+// A sleeping entity only thinks once it is due to or its archetype's alarm has gone off since it fell asleep.
+void thinkEntity(GameState* state, int kind, int index) {
+	EntityArchetype& archetype = state->entities.archetypes[kind];
+	if (archetype.dead[index]) {
+		return;
+	}
+	const Sleep& sleep = archetype.sleep[index];
+	if (sleep.asleep) {
+		if (state->worldTime < sleep.thinkAt and archetype.alarmAt < sleep.since) {
+			return;
+		}
+		archetype.location[index] = sleep.host->location + sleep.offset; // its host has already moved this tick
+		archetype.wake(index);
+	}
+	if (kind == KindCargo) {
+		cargoThink(state, archetype, index);
+	}
+	if (kind == KindPirate) {
+		pirateThink(state, archetype, index);
+	}
+	if (isIdle(state, archetype, index) and fallAsleep(state, archetype, index)) {
+		return;
+	}
+	// Run the avoid bodies function to get the current destination
+	avoidBodies(state, archetype.navigation[index], archetype.location[index]);
+}
+
+// Runs every entity system for one tick, each over one archetype at a time.
+// Only the entities the scheduler picks think, every entity moves or is carried by the body it sleeps by.
+void updateEntities(GameState* state) {
+	EntityArchetype& ships = state->entities.archetypes[KindCargo];
+	EntityArchetype& pirates = state->entities.archetypes[KindPirate];
+	if (state->player != nullptr) {
+		state->entities.wakeNear(state, state->player->getLocation());
+	}
+	state->ai.run(state);
+	navigationSystem(state, ships);
+	navigationSystem(state, pirates);
+	pirateAttackSystem(state, pirates);
+}
+
+// Takes health from an entity and kills it at 0, returns the health left.
+// A ref to an entity that is already dead or removed does nothing.
+int damageEntity(GameState* state, EntityRef ref, int dam) {
+	EntityWorld& entities = state->entities;
+	if (!entities.isAlive(ref)) {
+		return 0;
+	}
+	int& health = entities.health(ref);
+	health -= dam;
+	if (entities.isAsleep(ref)) {
+		entities.wake(ref);
+	}
+
+	GameEvent event;
+	event.type = GameEvent::Hit;
+	event.entity = ref;
+	event.amount = (float)dam;
+	event.location = entities.location(ref);
+	state->events.publish(event);
+
+	if (health <= 0) {
+		entities.kill(ref);
+		event.type = GameEvent::Kill;
+		state->events.publish(event);
+	}
+	return health;
+}
+
+// Removes the entities killed this tick and drops the player's lock on if its entity is gone.
+void removeDeadEntities(GameState* state) {
+	state->entities.compact();
+	if (state->player != nullptr and !state->entities.isAlive(state->player->getLockedOn())) {
+		state->player->unlockLockon();
+	}
+}
@@ -0,0 +1,321 @@
+/*
+* Entity storage split by archetype.
+* Every kind of entity keeps each of its components in its own contiguous array, entity i of a kind is index i
+* of every array. The systems in Entities.cpp each walk one archetype's arrays from start to end.
+* Outside the systems entities are named by generational handles that go through a slot table, so they stay
+* correct when the arrays are compacted and can tell when the entity they named is gone.
+* An entity with nothing to do away from the player falls asleep by the nearest body and is carried along with it,
+* it costs nothing to move until something wakes it, see Sleep.
+*/
+
+#pragma once
+#include <vector>
+
+#include "BSLA.h"
+#include "GravityCache.h"
+
+struct GameState;
+class Body;
+class City;
+
+// The archetypes, each has the components listed in EntityArchetype.
+enum EntityKind { KindCargo, KindPirate, KINDCOUNT };
+
+enum AIBehavior { Reckless, Cautious, Driveby };
+enum AIBAim { PoorAim, ExactAim, LeadingAim };
+
+// Names one entity for as long as it lives, safe to keep across ticks.
+// Slots are reused once an entity is removed, the generation tells the old and new occupant apart
+// so a ref to a dead entity is caught by EntityWorld::isAlive instead of reaching whatever took its slot.
+struct EntityRef {
+	int slot = -1;
+	unsigned int generation = 0;
+	EntityRef() {}
+	EntityRef(int s, unsigned int g) : slot(s), generation(g) {}
+	bool valid() const { return slot >= 0; } // names some entity, it may be dead since
+	bool operator==(const EntityRef& other) const { return slot == other.slot and generation == other.generation; }
+	bool operator!=(const EntityRef& other) const { return !(*this == other); }
+};
+
+// Where a slot's entity is stored, kind is -1 while the slot is free.
+struct EntitySlot {
+	int kind = -1;
+	int index = -1;
+	unsigned int generation = 0;
+	int nextFree = -1;
+};
+
+// Where an entity wants to go, location and speed are separate components.
+struct Navigation {
+	Vector2D destination = Vector2D(0, 0);
+	Vector2D start = Vector2D(0, 0);
+	Vector2D currentDest = Vector2D(0, 0); // the destination after avoiding bodies
+	Body* closestBody = nullptr; // the body being avoided
+	double impulseSpeed = 20;
+};
+
+static const double ENTITYSLEEPRANGE = 2000; // an entity only falls asleep this far from the player
+static const double ENTITYWAKERANGE = 1500; // and is woken when the player comes this close
+static const double ENTITYRESTRANGE = 300; // from a body's surface, an idle entity further out keeps wandering until it is this close
+static const double ENTITYSLEEPCHECK = 5; // seconds a sleeping entity sleeps before it thinks whether it is still idle
+
+// An idle entity resting by a body, moved with the body rather than under gravity.
+// Thinking again after ENTITYSLEEPCHECK, its archetype's alarm, being hit or the player coming near wakes it.
+struct Sleep {
+	bool asleep = false;
+	Body* host = nullptr;
+	Vector2D offset; // from host
+	double since = 0; // worldTime it fell asleep
+	double thinkAt = 0; // worldTime it next thinks
+};
+
+static const double CARGOTRIPSPEED = 600; // world units per second a cargo ship is reckoned to average between cities
+
+// Cargo ships, bring supplies from producer to consumer cities.
+struct CargoHold {
+	int cargoCount = 0;
+	int cargoCap = 10;
+	City* destCity = nullptr;
+	bool exporting = false; // taking a full hold to a neighbouring sector, see Sectors.h
+};
+
+// Pirates, chase and shoot the player.
+struct PirateBrain {
+	AIBehavior behavior = Driveby;
+	float attackTimer = 0.25;
+	bool engaged = false; // the player was in range when it last thought
+};
+
+/*
+* All entities of one kind.
+* cargo is only filled for KindCargo and brain only for KindPirate, the other arrays always match size().
+*/
+class EntityArchetype {
+public:
+	int kind = 0;
+	char faction = 'n'; // n no faction, e enemy
+	double alarmAt = -1; // worldTime something happened that the sleeping entities should think again about
+	std::vector<Vector2D> location;
+	std::vector<Vector2D> speed;
+	std::vector<Navigation> navigation;
+	std::vector<GravityCache> gravity;
+	std::vector<int> health;
+	std::vector<char> dead; // set by damageEntity, removed by removeDeadEntities
+	std::vector<int> slot; // the EntityWorld slot naming each entity
+	std::vector<Sleep> sleep;
+	std::vector<CargoHold> cargo;
+	std::vector<PirateBrain> brain;
+
+	int size() const { return (int)location.size(); }
+	int add(Vector2D newLocation, Vector2D destination, int entitySlot) {
+		Navigation nav;
+		nav.destination = destination;
+		nav.currentDest = destination; // until it first thinks
+		location.push_back(newLocation);
+		speed.push_back(Vector2D(0, 0));
+		navigation.push_back(nav);
+		gravity.push_back(GravityCache());
+		health.push_back(10);
+		dead.push_back(0);
+		slot.push_back(entitySlot);
+		sleep.push_back(Sleep());
+		if (kind == KindCargo) {
+			cargo.push_back(CargoHold());
+		}
+		if (kind == KindPirate) {
+			brain.push_back(PirateBrain());
+		}
+		return size() - 1;
+	}
+	// Moves the last entity into index and drops the last slot.
+	void removeSwap(int index) {
+		int last = size() - 1;
+		location[index] = location[last]; location.pop_back();
+		speed[index] = speed[last]; speed.pop_back();
+		navigation[index] = navigation[last]; navigation.pop_back();
+		gravity[index] = gravity[last]; gravity.pop_back();
+		health[index] = health[last]; health.pop_back();
+		dead[index] = dead[last]; dead.pop_back();
+		slot[index] = slot[last]; slot.pop_back();
+		sleep[index] = sleep[last]; sleep.pop_back();
+		if (kind == KindCargo) {
+			cargo[index] = cargo[last]; cargo.pop_back();
+		}
+		if (kind == KindPirate) {
+			brain[index] = brain[last]; brain.pop_back();
+		}
+	}
+	void reserve(int count) {
+		location.reserve(count); speed.reserve(count); navigation.reserve(count); gravity.reserve(count);
+		health.reserve(count);
+		dead.reserve(count); slot.reserve(count); sleep.reserve(count);
+		if (kind == KindCargo) {
+			cargo.reserve(count);
+		}
+		if (kind == KindPirate) {
+			brain.reserve(count);
+		}
+	}
+	void clear() {
+		location.clear(); speed.clear(); navigation.clear(); gravity.clear(); health.clear(); dead.clear(); slot.clear();
+		sleep.clear(); cargo.clear(); brain.clear();
+		alarmAt = -1;
+	}
+	// Lets a sleeping entity move under gravity again from where its host carried it.
+	void wake(int index) {
+		sleep[index].asleep = false;
+		sleep[index].host = nullptr;
+		gravity[index].invalidate();
+	}
+	int asleepCount() const {
+		int total = 0;
+		for (const Sleep& entry : sleep) {
+			total += entry.asleep;
+		}
+		return total;
+	}
+};
+
+/*
+* Every entity in the game, one archetype per EntityKind, and the slot table handles are resolved through.
+* Spawning takes a slot off the free list and appends to the archetype, kill marks the entity dead and queues its
+* slot, and compact removes everything queued in one pass at the end of the tick. Each of those is O(1) per entity.
+*/
+class EntityWorld {
+private:
+	std::vector<EntitySlot> slots;
+	int freeHead = -1;
+	std::vector<int> killed; // slots to remove at the next compact
+	std::vector<EntityRef> nearPlayer; // scratch for waking the entities the player comes close to
+
+	EntityRef spawn(int kind, Vector2D location, Vector2D destination) {
+		if (freeHead == -1) {
+			freeHead = (int)slots.size();
+			slots.push_back(EntitySlot());
+		}
+		int newSlot = freeHead;
+		EntitySlot& entry = slots[newSlot];
+		freeHead = entry.nextFree;
+		entry.nextFree = -1;
+		entry.kind = kind;
+		entry.index = archetypes[kind].add(location, destination, newSlot);
+		return EntityRef(newSlot, entry.generation);
+	}
+	EntitySlot& at(EntityRef ref) { return slots[ref.slot]; }
+public:
+	EntityArchetype archetypes[KINDCOUNT];
+
+	EntityWorld() {
+		archetypes[KindCargo].kind = KindCargo;
+		archetypes[KindPirate].kind = KindPirate;
+		archetypes[KindPirate].faction = 'e';
+	}
+	int count() const {
+		int total = 0;
+		for (int k = 0; k < KINDCOUNT; k++) {
+			total += archetypes[k].size();
+		}
+		return total;
+	}
+	int asleepCount() const {
+		int total = 0;
+		for (int k = 0; k < KINDCOUNT; k++) {
+			total += archetypes[k].asleepCount();
+		}
+		return total;
+	}
+	// Grows the slot table and every archetype to hold count entities so spawning up to it does not allocate.
+	void reserve(int count) {
+		while ((int)slots.size() < count) {
+			slots.push_back(EntitySlot());
+			slots.back().nextFree = freeHead;
+			freeHead = (int)slots.size() - 1;
+		}
+		for (int k = 0; k < KINDCOUNT; k++) {
+			archetypes[k].reserve(count);
+		}
+		killed.reserve(count);
+		nearPlayer.reserve(count);
+	}
+	EntityRef spawnCargo(Vector2D location, Vector2D destination) {
+		return spawn(KindCargo, location, destination);
+	}
+	EntityRef spawnPirate(AIBehavior behavior, Vector2D location, Vector2D destination) {
+		EntityRef ref = spawn(KindPirate, location, destination);
+		archetypes[KindPirate].brain[at(ref).index].behavior = behavior;
+		return ref;
+	}
+	// The handle of the entity at index of an archetype, for systems that walk the arrays.
+	EntityRef refAt(int kind, int index) {
+		int entitySlot = archetypes[kind].slot[index];
+		return EntityRef(entitySlot, slots[entitySlot].generation);
+	}
+	// False for refs that never named an entity, whose entity was removed, or that are dead awaiting removal.
+	bool isAlive(EntityRef ref) {
+		if (ref.slot < 0 or ref.slot >= (int)slots.size()) {
+			return false;
+		}
+		EntitySlot& entry = slots[ref.slot];
+		return entry.generation == ref.generation and entry.kind >= 0 and !archetypes[entry.kind].dead[entry.index];
+	}
+	// The accessors below expect a ref that isAlive (or dead this tick but not yet removed).
+	Vector2D& location(EntityRef ref) { return archetypes[at(ref).kind].location[at(ref).index]; }
+	Vector2D& speed(EntityRef ref) { return archetypes[at(ref).kind].speed[at(ref).index]; }
+	Navigation& navigation(EntityRef ref) { return archetypes[at(ref).kind].navigation[at(ref).index]; }
+	int& health(EntityRef ref) { return archetypes[at(ref).kind].health[at(ref).index]; }
+	char faction(EntityRef ref) { return archetypes[at(ref).kind].faction; }
+	CargoHold& cargo(EntityRef ref) { return archetypes[at(ref).kind].cargo[at(ref).index]; } // KindCargo only
+	PirateBrain& brain(EntityRef ref) { return archetypes[at(ref).kind].brain[at(ref).index]; } // KindPirate only
+	void wake(EntityRef ref) { archetypes[at(ref).kind].wake(at(ref).index); }
+	bool isAsleep(EntityRef ref) { return archetypes[at(ref).kind].sleep[at(ref).index].asleep; }
+	// Wakes every sleeping entity within ENTITYWAKERANGE of location, found through the spatial index.
+	void wakeNear(GameState* state, Vector2D location);
+	// Marks a live entity dead, it stays in its archetype until compact. Also used to remove one handed to another sector.
+	void kill(EntityRef ref) {
+		archetypes[at(ref).kind].dead[at(ref).index] = 1;
+		killed.push_back(ref.slot);
+	}
+	// Removes every entity killed since the last compact, each by moving the last of its archetype into the hole.
+	// Their slots go back on the free list with a new generation so old refs to them stop being alive.
+	void compact() {
+		for (int deadSlot : killed) {
+			EntitySlot& entry = slots[deadSlot];
+			EntityArchetype& archetype = archetypes[entry.kind];
+			archetype.removeSwap(entry.index);
+			if (entry.index < archetype.size()) {
+				slots[archetype.slot[entry.index]].index = entry.index;
+			}
+			entry.kind = -1;
+			entry.index = -1;
+			entry.generation++;
+			entry.nextFree = freeHead;
+			freeHead = deadSlot;
+		}
+		killed.clear();
+	}
+	// Removes every entity, slots are kept and given new generations so refs from before stay stale.
+	void clear() {
+		for (int k = 0; k < KINDCOUNT; k++) {
+			archetypes[k].clear();
+		}
+		freeHead = -1;
+		for (int i = (int)slots.size() - 1; i >= 0; i--) {
+			if (slots[i].kind >= 0) {
+				slots[i].generation++;
+			}
+			slots[i].kind = -1;
+			slots[i].index = -1;
+			slots[i].nextFree = freeHead;
+			freeHead = i;
+		}
+		killed.clear();
+	}
+};
+
+// See Entities.cpp for descriptions.
+void avoidBodies(GameState* state, Navigation& nav, Vector2D location);
+void navigate(GameState* state, Navigation& nav, GravityCache& gravity, Vector2D& location, Vector2D& speed);
+void thinkEntity(GameState* state, int kind, int index);
+void updateEntities(GameState* state);
+int damageEntity(GameState* state, EntityRef ref, int dam);
+void removeDeadEntities(GameState* state);
@@ -0,0 +1,69 @@
+/*
+* Typed game events.
+* Anything in the update can publish an event, from any thread, and the subscribers see every event
+* once per tick when the update dispatches them.
+* Events should never be used for important pieces of game control (exiting, saving, ect),
+* only for things that could be thrown away if the ring overflows.
+*/
+
+#pragma once
+#include <atomic>
+#include <vector>
+
+#include "BSLA.h"
+#include "Entities.h"
+#include "LockFree.h"
+
+struct GameState;
+
+// One event, plain data so it can be copied through the ring.
+struct GameEvent {
+	enum Type : unsigned char { Kill, Hit, CargoDelivered, CityFull };
+	Type type = Hit;
+	bool isPlayer = false; // Hit and Kill on the player ship rather than entity
+	EntityRef entity; // Kill, Hit, CargoDelivered, check EntityWorld::isAlive before following it at dispatch
+	int cityID = -1; // CargoDelivered, CityFull
+	float amount = 0; // Hit damage, CargoDelivered cargo
+	Vector2D location;
+};
+
+typedef void (*EventSubscriber)(const GameEvent& event, GameState* state);
+
+class EventBus {
+private:
+	static const int CAPACITY = 1024; // a power of two
+	MPSCQueue<GameEvent, CAPACITY> ring;
+	std::atomic<unsigned int> dropped;
+	std::vector<EventSubscriber> subscribers;
+public:
+	EventBus() : dropped(0) {}
+	// Not thread safe, subscribe before the simulation starts.
+	void subscribe(EventSubscriber subscriber) { subscribers.push_back(subscriber); }
+	// Safe from any thread, returns false and counts the event as dropped if the ring is full.
+	bool publish(const GameEvent& event) {
+		if (!ring.push(event)) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		return true;
+	}
+	// Hands every waiting event to every subscriber, only called from the update. Returns how many there were.
+	int dispatch(GameState* state) {
+		int count = 0;
+		GameEvent event;
+		while (ring.pop(event)) {
+			for (EventSubscriber subscriber : subscribers) {
+				subscriber(event, state);
+			}
+			count++;
+		}
+		return count;
+	}
+	// Throws away every waiting event.
+	void clear() {
+		GameEvent event;
+		while (ring.pop(event)) {}
+	}
+	// events lost to a full ring since the last call
+	unsigned int takeDropped() { return dropped.exchange(0, std::memory_order_relaxed); }
+};
@@ -0,0 +1,73 @@
+#include "FramePacer.h"
+
+#include <math.h>
+
+void FramePacer::setRate(double rate) {
+	frequency = SDL_GetPerformanceFrequency();
+	period = rate > 0 ? (Uint64)(frequency / rate) : 0;
+	due = 0;
+}
+
+void FramePacer::wait() {
+	if (frequency == 0) {
+		frequency = SDL_GetPerformanceFrequency();
+	}
+	if (period > 0) {
+		Uint64 now = SDL_GetPerformanceCounter();
+		// a frame that ran more than a whole period late starts the schedule over rather than rushing to catch up
+		if (due == 0 or now > due + period) {
+			due = now;
+		}
+		due += period;
+
+		double minSpin = PACERMINSPIN * frequency;
+		double maxSpin = PACERMAXSPIN * frequency;
+		while (true) {
+			now = SDL_GetPerformanceCounter();
+			double spin = fmin(maxSpin, fmax(minSpin, oversleep * 1.25));
+			if (now >= due or due - now <= spin) {
+				break;
+			}
+			Uint64 asked = (Uint64)(due - now - spin);
+			SDL_DelayNS((Uint64)(asked * 1000000000.0 / frequency));
+			Uint64 woke = SDL_GetPerformanceCounter();
+			// remembers the worst recent oversleep and lets it fade so one bad wake does not spin forever
+			double late = (double)(woke - now) - (double)asked;
+			oversleep = fmax(late, oversleep * 0.98);
+		}
+		while (SDL_GetPerformanceCounter() < due) {
+			// spin the rest
+		}
+	}
+
+	Uint64 now = SDL_GetPerformanceCounter();
+	if (lastFrame != 0) {
+		intervals[intervalNext] = now - lastFrame;
+		intervalNext = (intervalNext + 1) % PACERHISTORY;
+		if (intervalCount < PACERHISTORY) {
+			intervalCount++;
+		}
+	}
+	lastFrame = now;
+}
+
+void FramePacer::getStats(PacerStats& out) {
+	out = PacerStats();
+	if (intervalCount == 0 or frequency == 0) {
+		return;
+	}
+	double toMs = 1000.0 / frequency;
+	double sum = 0;
+	for (int i = 0; i < intervalCount; i++) {
+		sum += intervals[i] * toMs;
+		out.worst = fmax(out.worst, intervals[i] * toMs);
+	}
+	out.average = sum / intervalCount;
+	double squares = 0;
+	for (int i = 0; i < intervalCount; i++) {
+		double difference = intervals[i] * toMs - out.average;
+		squares += difference * difference;
+	}
+	out.jitter = sqrt(squares / intervalCount);
+	out.spin = fmin(PACERMAXSPIN * frequency, fmax(PACERMINSPIN * frequency, oversleep * 1.25)) * toMs;
+}
@@ -0,0 +1,40 @@
+/*
+* Holds the render loop to a target frame rate without burning a core.
+* Each frame sleeps until shortly before it is due and spins on SDL_GetPerformanceCounter for the rest, the sleep
+* is cut short by how late the OS has been waking it so the spin is only as long as it needs to be.
+* The time between frames is kept so the jitter can be shown.
+*/
+
+#pragma once
+#include <SDL3/SDL.h>
+
+static const double PACERDEFAULTRATE = 144; // frames per second, the same as the simulation's tick rate
+static const double PACERMINSPIN = 0.0002; // seconds before a frame is due the sleep always stops
+static const double PACERMAXSPIN = 0.004; // seconds of spinning at most, however late the sleeps wake
+static const int PACERHISTORY = 240; // frame times kept for the stats
+
+// Frame times over the recorded frames, in milliseconds.
+struct PacerStats {
+	double average = 0;
+	double jitter = 0; // standard deviation
+	double worst = 0;
+	double spin = 0; // how long before a frame is due the sleep stops
+};
+
+class FramePacer {
+private:
+	Uint64 frequency = 0;
+	Uint64 period = 0; // 0 runs flat out
+	Uint64 due = 0; // when the next frame should start
+	Uint64 lastFrame = 0;
+	double oversleep = 0; // the latest a sleep has woken recently, in counter ticks
+	Uint64 intervals[PACERHISTORY] = {};
+	int intervalCount = 0;
+	int intervalNext = 0;
+public:
+	// Frames per second to hold to, 0 or less runs flat out.
+	void setRate(double rate);
+	// Waits until the next frame is due, call once at the end of every frame.
+	void wait();
+	void getStats(PacerStats& out);
+};
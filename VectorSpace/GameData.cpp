@@ -1,9 +1,11 @@
 #include "GameData.h"
+#include "WorldGen.h"
+#include <algorithm>
 #include <iostream>
 
 // Calculates the force of gravity based on mass, distance, and the gravity constant.
-double calcGravity(double mass, double distance) {
-	double grav = (GCONST * mass) / (distance * distance);
+simScalar calcGravity(simScalar mass, simScalar distance) {
+	simScalar grav = (simScalar(GCONST) * mass) / (distance * distance);
 	return grav;
 }
 
@@ -19,81 +21,171 @@ Vector2D getOrbitSpeed(Body* toOrbit, Vector2D myLocation) {
 }
 
 // Calculates the speed vector bodies are causing to a location from their gravity.
+// Runs a lane pack of bodies at a time from state->bodyLanes.
 Vector2D doGravity(GameState* state, Vector2D location) {
-	std::vector<StaticGravBody*> staticGravBodies = state->staticGravBodies;
-	std::vector<DynamicGravBody*> dynamicGravBodies = state->dynamicGravBodies;
-	Vector2D deltaVec;
-
-	for (auto body : staticGravBodies) {
-		Vector2D locVec = body->location - location;
-		//if (locVec.magnitude() > 1000) { //
-		//	continue;
-		//}
-
-		double grav = calcGravity(body->mass, locVec.magnitude());
-
-		// normalize vector
-		locVec = locVec * (1 / locVec.magnitude());
-		 
-		deltaVec = deltaVec + locVec * grav;
-	}  
-	for (auto body : dynamicGravBodies) {
-		Vector2D locVec = body->location - location;
-		if (locVec.magnitude() == 0){//or locVec.magnitude() > 1000) {
-			continue;
-		}
-
-		double grav = calcGravity(body->mass, locVec.magnitude());
-
-		if (locVec.x == 0) { // Sets vector direction
-			locVec.x = 0;
-		}
-		else {
-			locVec.x = locVec.x / abs(locVec.x);
-		}
-		if (locVec.y == 0) {
-			locVec.x = 0;
-		}
-		else {
-			locVec.y = locVec.y / abs(locVec.y);
-		}
-
-		deltaVec = deltaVec + locVec * grav;
+	PROFILE_ZONE("doGravity");
+	const BodyLanes& lanes = state->bodyLanes;
+	const Vector2DLanes here(location);
+	const SimLanes gConst(GCONST);
+	const SimLanes zero(0); const SimLanes one(1); const SimLanes minusOne(-1);
+	Vector2DLanes deltaVec;
+
+	for (int i = 0; i < lanes.staticEnd; i += SimLanes::LANES) {
+		Vector2DLanes locVec = Vector2DLanes::load(&lanes.x[i], &lanes.y[i]) - here;
+		SimLanes distance = locVec.magnitude();
+		SimLanes grav = gConst * SimLanes::load(&lanes.mass[i]) / (distance * distance);
+
+		deltaVec = deltaVec + locVec.normalize() * grav;
 	}
-	
-	return deltaVec;
+	for (int i = lanes.dynamicStart; i < lanes.dynamicEnd; i += SimLanes::LANES) {
+		Vector2DLanes locVec = Vector2DLanes::load(&lanes.x[i], &lanes.y[i]) - here;
+		SimLanes distance = locVec.magnitude();
+		SimLanes grav = gConst * SimLanes::load(&lanes.mass[i]) / (distance * distance);
+
+		// Sets vector direction to the sign of each component, a body level with the location pulls nowhere
+		Vector2DLanes direction(
+			SimLanes::select(locVec.x == zero, zero, SimLanes::select(locVec.x < zero, minusOne, one)),
+			SimLanes::select(locVec.y < zero, minusOne, one));
+		direction = Vector2DLanes::select(locVec.y == zero, Vector2DLanes(), direction);
+
+		deltaVec = Vector2DLanes::select(distance != zero, deltaVec + direction * grav, deltaVec);
+	}
+
+	return deltaVec.sum();
 }
 
 
 // checks if a location is within a body.
+// Compares squared distances so the lanes do not need a square root.
 Body* willCollide(GameState* state, Vector2D location) {
-	std::vector<StaticGravBody*> staticGravBodies = state->staticGravBodies;
-	std::vector<DynamicGravBody*> dynamicGravBodies = state->dynamicGravBodies;
-	for (auto body : staticGravBodies) {
-		Vector2D locVec = (body->location+body->speed * state->deltaT) - location;
-		if (locVec.magnitude() < body->radius) {
-			return body;
+	PROFILE_ZONE("willCollide");
+	const BodyLanes& lanes = state->bodyLanes;
+	const Vector2DLanes here(location);
+	const SimLanes deltaT(state->deltaT);
+	const SimLanes zero(0);
+	for (int i = 0; i < lanes.staticEnd; i += SimLanes::LANES) {
+		Vector2DLanes bodyLocation = Vector2DLanes::load(&lanes.x[i], &lanes.y[i]);
+		Vector2DLanes bodySpeed = Vector2DLanes::load(&lanes.speedX[i], &lanes.speedY[i]);
+		SimLanes radius = SimLanes::load(&lanes.radius[i]);
+		SimLanes distanceSquared = ((bodyLocation + bodySpeed * deltaT) - here).magnitudeSquared();
+		int hits = (distanceSquared < radius * radius).bits();
+		if (hits != 0) {
+			return lanes.bodies[i + firstLane(hits)];
 		}
 	}
-	for (auto body : dynamicGravBodies) {
-		Vector2D locVec = (body->location + body->speed * state->deltaT) - location;
-		if (locVec.magnitude() != 0) {
-			if (locVec.magnitude() < body->radius) {
-				return body;
-			}
+	for (int i = lanes.dynamicStart; i < lanes.dynamicEnd; i += SimLanes::LANES) {
+		Vector2DLanes bodyLocation = Vector2DLanes::load(&lanes.x[i], &lanes.y[i]);
+		Vector2DLanes bodySpeed = Vector2DLanes::load(&lanes.speedX[i], &lanes.speedY[i]);
+		SimLanes radius = SimLanes::load(&lanes.radius[i]);
+		SimLanes distanceSquared = ((bodyLocation + bodySpeed * deltaT) - here).magnitudeSquared();
+		int hits = ((distanceSquared != zero) & (distanceSquared < radius * radius)).bits();
+		if (hits != 0) {
+			return lanes.bodies[i + firstLane(hits)];
 		}
 	}
 	return nullptr;
 }
 
+// How long something at location moving no faster than speed is sure not to be inside any body, 0 when it is now.
+// Dynamic bodies are taken to move no faster than the fastest of them is now plus what the fastest acceleration could
+// add, which only holds for a little while, so the answer is never more than CLEARANCEHORIZON.
+double bodyClearance(GameState* state, Vector2D location, double speed) {
+	const BodyLanes& lanes = state->bodyLanes;
+	const int width = SimLanes::LANES;
+	const Vector2DLanes here(location);
+	SimLanes staticGap(1e15f);
+	SimLanes dynamicGap(1e15f);
+	for (int i = 0; i < lanes.staticEnd; i += width) {
+		Vector2DLanes bodyLocation = Vector2DLanes::load(&lanes.x[i], &lanes.y[i]);
+		SimLanes gap = (bodyLocation - here).magnitude() - SimLanes::load(&lanes.radius[i]);
+		staticGap = SimLanes::select(gap < staticGap, gap, staticGap);
+	}
+	for (int i = lanes.dynamicStart; i < lanes.dynamicEnd; i += width) {
+		Vector2DLanes bodyLocation = Vector2DLanes::load(&lanes.x[i], &lanes.y[i]);
+		SimLanes gap = (bodyLocation - here).magnitude() - SimLanes::load(&lanes.radius[i]);
+		dynamicGap = SimLanes::select(gap < dynamicGap, gap, dynamicGap);
+	}
+	simScalar staticGaps[width];
+	simScalar dynamicGaps[width];
+	staticGap.store(staticGaps);
+	dynamicGap.store(dynamicGaps);
+	double nearestStatic = staticGaps[0];
+	double nearestDynamic = dynamicGaps[0];
+	for (int lane = 1; lane < width; lane++) {
+		nearestStatic = fmin(nearestStatic, staticGaps[lane]);
+		nearestDynamic = fmin(nearestDynamic, dynamicGaps[lane]);
+	}
+	if (nearestStatic <= 0 or nearestDynamic <= 0) {
+		return 0;
+	}
+
+	// doubled as lastAccel is only what they did over their last update
+	double bodySpeed = lanes.maxDynamicSpeed + 2 * lanes.maxDynamicAccel * CLEARANCEHORIZON;
+	double clearance = CLEARANCEHORIZON;
+	if (speed > 0) {
+		clearance = fmin(clearance, nearestStatic / speed);
+	}
+	if (speed + bodySpeed > 0) {
+		clearance = fmin(clearance, nearestDynamic / (speed + bodySpeed));
+	}
+	return clearance;
+}
+
+// Copies every body into state->bodyLanes, call after bodies move or are added or removed.
+void refreshBodyLanes(GameState* state) {
+	BodyLanes& lanes = state->bodyLanes;
+	const int width = SimLanes::LANES;
+	int staticCount = (int)state->staticGravBodies.size();
+	int dynamicCount = (int)state->dynamicGravBodies.size();
+	lanes.staticEnd = (staticCount + width - 1) / width * width;
+	lanes.dynamicStart = lanes.staticEnd;
+	lanes.dynamicEnd = lanes.dynamicStart + (dynamicCount + width - 1) / width * width;
+	if (staticCount + dynamicCount != lanes.bodyCount) {
+		state->spatialIndex.bodiesChanged();
+	}
+	lanes.bodyCount = staticCount + dynamicCount;
+
+	// padding sits far away with no mass or size so it never pulls or collides
+	const simScalar farAway = 1e15f;
+	lanes.x.assign(lanes.dynamicEnd, farAway);
+	lanes.y.assign(lanes.dynamicEnd, farAway);
+	lanes.speedX.assign(lanes.dynamicEnd, 0);
+	lanes.speedY.assign(lanes.dynamicEnd, 0);
+	lanes.radius.assign(lanes.dynamicEnd, 0);
+	lanes.mass.assign(lanes.dynamicEnd, 0);
+	lanes.bodies.assign(lanes.dynamicEnd, nullptr);
+	lanes.maxDynamicSpeed = 0;
+	lanes.maxDynamicAccel = 0;
+
+	for (int i = 0; i < staticCount + dynamicCount; i++) {
+		Body* body;
+		int slot;
+		if (i < staticCount) {
+			body = state->staticGravBodies[i];
+			slot = i;
+		}
+		else {
+			body = state->dynamicGravBodies[i - staticCount];
+			slot = lanes.dynamicStart + i - staticCount;
+		}
+		lanes.x[slot] = body->location.x; lanes.y[slot] = body->location.y;
+		lanes.speedX[slot] = body->speed.x; lanes.speedY[slot] = body->speed.y;
+		lanes.radius[slot] = body->radius;
+		lanes.mass[slot] = body->mass;
+		lanes.bodies[slot] = body;
+		if (i >= staticCount) {
+			lanes.maxDynamicSpeed = fmax(lanes.maxDynamicSpeed, body->speed.magnitude());
+			lanes.maxDynamicAccel = fmax(lanes.maxDynamicAccel, state->dynamicGravBodies[i - staticCount]->lastAccel.magnitude());
+		}
+	}
+}
+
 // gets the closest body to a location.
 Body* closestToPoint(GameState* state, Vector2D location) {
 	Body* toReturn = nullptr;
 	double curLowMag = -1;
-	std::vector<StaticGravBody*> staticGravBodies = state->staticGravBodies;
-	std::vector<DynamicGravBody*> dynamicGravBodies = state->dynamicGravBodies;
 
-	for (auto body : staticGravBodies) {
+	for (auto body : state->staticGravBodies) {
 		// get distance from the bodies surface
 		double locVec = (body->location - location).magnitude() - body->radius;
 
@@ -102,7 +194,7 @@ Body* closestToPoint(GameState* state, Vector2D location) {
 			curLowMag = locVec;
 		}
 	}
-	for (auto body : dynamicGravBodies) {
+	for (auto body : state->dynamicGravBodies) {
 		double locVec = (body->location - location).magnitude() - body->radius;
 		if (curLowMag == -1 or locVec < curLowMag) {
 			toReturn = body;
@@ -113,24 +205,51 @@ Body* closestToPoint(GameState* state, Vector2D location) {
 	return toReturn;
 }
 
-// Fills a play area with systems.
-void generatePlaySpace(double systemRad, double systemPad, int seed, GameState* state) {
-	for (double y = -AREASIZE + systemRad; y < AREASIZE; y = y + 2*systemRad + systemPad) {
-		for (double x = -AREASIZE + systemRad; x < AREASIZE; x = x + 2*systemRad + systemPad) {
-			randSystemAt(Vector2D(x,y), seed++, state, systemRad);
+// Where the systems of a play area go and the seed each is built from, in the order generatePlaySpace builds them.
+void playSpaceSystems(double systemRad, double systemPad, int seed, double areaSize, std::vector<SystemSite>& out) {
+	out.clear();
+	for (double y = -areaSize + systemRad; y < areaSize; y = y + 2*systemRad + systemPad) {
+		for (double x = -areaSize + systemRad; x < areaSize; x = x + 2*systemRad + systemPad) {
+			SystemSite site;
+			site.location = Vector2D(x, y);
+			site.seed = seed++;
+			out.push_back(site);
 		}
 	}
+}
+
+// Fills a play area with systems.
+// areaSize only changes where systems are placed, it is larger than AREASIZE for the benchmarks.
+// WorldGenerator builds the same world in the background, see WorldGen.h.
+void generatePlaySpace(double systemRad, double systemPad, int seed, GameState* state, double areaSize) {
+	std::vector<SystemSite> sites;
+	playSpaceSystems(systemRad, systemPad, seed, areaSize, sites);
+	for (const SystemSite& site : sites) {
+		randSystemAt(site.location, site.seed, state, systemRad);
+	}
+	populatePlaySpace(state);
+
+	state->entityCap = state->entities.count();
+	state->entities.reserve(state->entityCap);
+	state->projectilePool.reserve(state, PROJECTILEPOOLSTART);
+	refreshBodyLanes(state);
+}
+
+// Ties cities to the planets and spawns their cargo ships and a pirate, once every system is built.
+// Only reads the bodies' addresses so the bodies can already be in use elsewhere.
+// startCities false leaves the cities' storage and the market to the state they are handed to, see WorldGenerator::adopt.
+void populatePlaySpace(GameState* state, bool startCities) {
 	int bodyCount = (int)state->staticGravBodies.size() + (int)state->dynamicGravBodies.size();
 	std::cout << "created " << bodyCount << " bodies\n";
 
 	for (int i = 0; i < bodyCount/4; i++) {
 		Body* tiedBody;
-		tiedBody = (state->dynamicGravBodies.at(rand() % state->dynamicGravBodies.size()));
+		tiedBody = (state->dynamicGravBodies.at(state->random.next() % state->dynamicGravBodies.size()));
 		int newID = (int)state->cities.size();
 		bool cityFail = false;
 
 		for (auto city : state->cities) {
-			if (tiedBody->bodyID == city->getTiedBody()->bodyID) { // check if a city is already using a body;
+			if (tiedBody == city->getTiedBody()) { // check if a city is already using a body;
 				cityFail = true;
 			}
 		}
@@ -147,35 +266,37 @@ void generatePlaySpace(double systemRad, double systemPad, int seed, GameState*
 	}
 
 	std::cout << "populated " << (int)state->cities.size() << " cities\n";
+	if (startCities) {
+		for (City* city : state->cities) {
+			city->startAt(state);
+		}
+		state->market.build(state);
+	}
 
 	for (int i = 0; i < (int)state->cities.size(); i++) {
-		Entity* newCargo = (Entity*) new EntityCargo();
 		int bound = AREASIZE * 2;
-		newCargo->getNav()->forceLocation(Vector2D((rand() % bound) - AREASIZE, (rand() % bound) - AREASIZE));
-		newCargo->getNav()->setDestination(Vector2D((rand() % bound) - AREASIZE, (rand() % bound) - AREASIZE));
-		state->entities.push_back((Entity*) newCargo);
+		Vector2D location = Vector2D((state->random.next() % bound) - AREASIZE, (state->random.next() % bound) - AREASIZE);
+		Vector2D destination = Vector2D((state->random.next() % bound) - AREASIZE, (state->random.next() % bound) - AREASIZE);
+		state->entities.spawnCargo(location, destination);
 	}
 	
-	Entity* newPirate = (Entity*) new EntityPirate(EntityPirate::AIBehavior::Driveby);
 	int bound = AREASIZE * 2;
-	newPirate->getNav()->forceLocation(Vector2D((rand() % bound) - AREASIZE, (rand() % bound) - AREASIZE));
-	newPirate->getNav()->setDestination(Vector2D((rand() % bound) - AREASIZE, (rand() % bound) - AREASIZE));
-	state->entities.push_back((Entity*)newPirate);
+	Vector2D pirateLocation = Vector2D((state->random.next() % bound) - AREASIZE, (state->random.next() % bound) - AREASIZE);
+	Vector2D pirateDestination = Vector2D((state->random.next() % bound) - AREASIZE, (state->random.next() % bound) - AREASIZE);
+	state->entities.spawnPirate(Driveby, pirateLocation, pirateDestination);
 
-	std::cout << "populated " << (int)state->entities.size() << " entities\n";
-
-	state->entityCap = (int)state->entities.size();
+	std::cout << "populated " << state->entities.count() << " entities\n";
 }
 
 
 // Creates a random solar system at a location.
 void randSystemAt(Vector2D location, int seed, GameState* state, double systemRadius){
-	srand(seed);
+	state->random.seed(seed);
 	int curRad; int curWeightMod;
 
 	// the core of a solar system
-	curRad = rand() % (175 - 75) + 75;
-	curWeightMod = rand() % (250 - 10) + 10;
+	curRad = state->random.next() % (175 - 75) + 75;
+	curWeightMod = state->random.next() % (250 - 10) + 10;
 
 	StaticGravBody* core = new StaticGravBody(location, curRad, curRad * curWeightMod);
 	core->bodyType = 's';
@@ -183,7 +304,7 @@ void randSystemAt(Vector2D location, int seed, GameState* state, double systemRa
 	state->staticGravBodies.push_back(core);
 
 	double usedRadius = core->radius + 60;
-	int maxPlanets = rand() % 10;
+	int maxPlanets = state->random.next() % 10;
 	double spacePerPlanet = (systemRadius - usedRadius) / maxPlanets;
 	double maxRad = spacePerPlanet / 2;
 	if (maxRad > core->radius) {
@@ -198,13 +319,13 @@ void randSystemAt(Vector2D location, int seed, GameState* state, double systemRa
 // creates a random dynamic body orbiting another
 // returns the radius it actualy used.
 double randBodyOrbiting(Body* toOrbit, int seed, GameState* state, double distance, double maxRadius){
-	srand(seed);
+	state->random.seed(seed);
 	double spentDistance;
 	int curRad; int curWeightMod;
 
-	curRad = rand() % (int) (maxRadius - 20) + 20;
-	curWeightMod = rand() % (15 - 5) + 5;
-	float randomTimeComp = (float)(rand() % (10-1) + 1) / 10;
+	curRad = state->random.next() % (int) (maxRadius - 20) + 20;
+	curWeightMod = state->random.next() % (15 - 5) + 5;
+	float randomTimeComp = (float)(state->random.next() % (10-1) + 1) / 10;
 
 	DynamicGravBody* bod = new DynamicGravBody(Vector2D(toOrbit->location.x + (float) distance, 0), curRad, curRad * curWeightMod, 1, -3.1415, 3.1415, randomTimeComp, (float) distance, (float) distance);
 	bod->orbitBody = toOrbit; bod->bodyType = 'p';
@@ -215,13 +336,68 @@ double randBodyOrbiting(Body* toOrbit, int seed, GameState* state, double distan
 	return spentDistance;
 }
 
+// Creates a cluster of small stars that move under each other's gravity (moveType 4).
+// Each star starts on a roughly circular path around the center, for the mass of the cluster inside its radius.
+void randClusterAt(Vector2D location, int seed, GameState* state, int bodyCount, double clusterRadius) {
+	state->random.seed(seed);
+	std::vector<DynamicGravBody*> stars;
+	double totalMass = 0;
+	for (int i = 0; i < bodyCount; i++) {
+		int curRad = state->random.next() % (30 - 8) + 8;
+		int curWeightMod = state->random.next() % (15 - 5) + 5;
+		// sqrt spreads the stars evenly over the disk rather than bunching them at the center
+		double distance = sqrt((double)state->random.next() / WorldRandom::MAX) * clusterRadius;
+		double angle = (double)state->random.next() / WorldRandom::MAX * 2 * 3.1415;
+		Vector2D offset = Vector2D(cos(angle) * distance, sin(angle) * distance);
+
+		DynamicGravBody* bod = new DynamicGravBody(location + offset, curRad, curRad * curWeightMod, 4);
+		bod->bodyType = 's';
+		bod->bodyID = (int) state->dynamicGravBodies.size();
+		state->dynamicGravBodies.push_back(bod);
+		stars.push_back(bod);
+		totalMass += bod->mass;
+	}
+	for (DynamicGravBody* star : stars) {
+		Vector2D offset = star->location - location;
+		double distance = offset.magnitude();
+		if (distance == 0) {
+			continue;
+		}
+		double massInside = totalMass * (distance * distance) / (clusterRadius * clusterRadius);
+		double velocity = sqrt(GCONST * massInside / distance);
+		star->speed = Vector2D(-offset.y, offset.x) * (velocity / distance);
+	}
+}
+
+// A new GameState in play with no player and nothing built yet, for worlds ticked without the menu:
+// the batch runs and the sectors around the player's.
+GameState* makeHeadlessWorld(int seed) {
+	GameState* state = new GameState;
+	state->curState = StagePlay;
+	state->resetFlag = false;
+	state->gamePause = false;
+	state->debugMode = false;
+	state->menuSelectorY = 0;
+	state->seed = seed;
+	state->entityCap = 0;
+	state->deltaT = 0;
+	state->player = nullptr;
+	return state;
+}
+
 // Resets the given gamestate and loads new bodies.
 // This does not
 void resetGameState(GameState* state) {
 	std::cout << "reached reset\n";
+	if (state->generator != nullptr) {
+		delete state->generator; // stops it, with whatever it built and the world had not taken in yet
+		state->generator = nullptr;
+	}
 	state->curState = StageStart;
 	state->deltaT = 0;
-	state->player->resetPlayer();
+	if (state->player != nullptr) {
+		state->player->resetPlayer();
+	}
 	for (auto body : state->staticGravBodies) {
 		delete body;
 		body = nullptr;
@@ -230,36 +406,35 @@ void resetGameState(GameState* state) {
 		delete body;
 		body = nullptr;
 	}
-	for (auto entity : state->entities) {
-		delete entity;
-		entity = nullptr;
-	}
 	for (auto city : state->cities) {
 		delete city;
 		city = nullptr;
 	}
 	for (auto projectile : state->projectiles) {
-		delete projectile;
-		projectile = nullptr;
+		state->projectilePool.release(projectile);
 	}
 	state->dynamicGravBodies.clear();
 	state->dynamicGravBodies.shrink_to_fit();
 	state->staticGravBodies.clear();
 	state->staticGravBodies.shrink_to_fit();
 	state->entities.clear();
-	state->entities.shrink_to_fit();
 	state->cities.clear();
 	state->cities.shrink_to_fit();
+	state->citySchedule.clear();
+	state->market.clear();
+	state->worldTime = 0;
 	state->projectiles.clear();
 	state->projectiles.shrink_to_fit();
-	state->eventStack.clear();
-	state->eventStack.shrink_to_fit();
+	state->events.clear();
+	state->nbody.clear();
+	state->spatialIndex.clear();
+	refreshBodyLanes(state);
 	state->resetFlag = false;
 
 	std::cout << "state reset\n";
 	std::cout << state->dynamicGravBodies.size() << " dbodies\n";
 	std::cout << state->staticGravBodies.size() << " sbodies\n";
-	std::cout << state->entities.size() << " entities\n";
+	std::cout << state->entities.count() << " entities\n";
 	std::cout << state->cities.size() << " cities\n";
 	std::cout << state->projectiles.size() << " projectiles\n";
 }
@@ -267,66 +442,135 @@ void resetGameState(GameState* state) {
 
 // Class Definitions
 
-//Playership
-bool PlayerShip::lockonClosest(GameState* state, float maxRange) {
-	float dist = -1;
-	Entity* entToLock = nullptr;
-	for (Entity* entity : state->entities) {
-		float curDist = (getLocation() - entity->getLocation()).magnitude();
-		if (curDist > maxRange and maxRange != 0) {
-			continue;
-		}
-		if ((curDist < dist) or (dist == -1)) {
-			entToLock = entity;
+//CitySchedule
+void CitySchedule::add(double time, City* city, int version) {
+	if (heap.size() == heap.capacity()) {
+		// drop the stale entries before growing, each city has at most one that is still current
+		heap.erase(std::remove_if(heap.begin(), heap.end(), [](const Entry& entry) {
+			return entry.version != entry.city->getScheduleVersion();
+		}), heap.end());
+		std::make_heap(heap.begin(), heap.end());
+	}
+	Entry entry;
+	entry.time = time;
+	entry.city = city;
+	entry.version = version;
+	heap.push_back(entry);
+	std::push_heap(heap.begin(), heap.end());
+}
+
+void CitySchedule::run(GameState* state) {
+	while (!heap.empty() and heap.front().time <= state->worldTime) {
+		Entry entry = heap.front();
+		std::pop_heap(heap.begin(), heap.end());
+		heap.pop_back();
+		if (entry.version == entry.city->getScheduleVersion()) {
+			entry.city->reachedFull(state);
 		}
 	}
-	if (entToLock == nullptr) {
-		entityLockedOn = nullptr;
-		return false;
+}
+
+//City
+// Starts a new line from amount now, and schedules when it will fill up.
+void City::restamp(GameState* state, float amount) {
+	storedAmount = amount;
+	storedAt = state->worldTime;
+	scheduleVersion++;
+	if (pcPS > 0 and storedAmount < storageLimit) {
+		state->citySchedule.add(fullAt(), this, scheduleVersion);
 	}
-	entityLockedOn = entToLock;
-	return true;
 }
 
-//EnemyShip
-void EntityPirate::update(GameState* state) {
-	if (cleanMe) {
-		return;
+float City::take(GameState* state, float requested) {
+	float currentStorage = getCurStorage(state->worldTime);
+	if (requested >= currentStorage) {
+		int temp = currentStorage;
+		restamp(state, 0);
+		return temp;
 	}
+	restamp(state, currentStorage - requested);
+	return requested;
+}
 
-	// movement
-	float dfp = (navHandler.getLocation() - state->player->getLocation()).magnitude();
-	Vector2D pte = (state->player->getLocation() - navHandler.getLocation()).normalize(); // player to entity
-	switch (currentBehavior) {
-	case Reckless:
-		if (dfp > 100) {
-			navHandler.setDestination(state->player->getLocation() + pte * 100);
+float City::give(GameState* state, float requested) {
+	float currentStorage = getCurStorage(state->worldTime);
+	if (currentStorage + requested > storageLimit) {
+		int remainder = storageLimit - (currentStorage + requested);
+		restamp(state, storageLimit);
+		if (currentStorage < storageLimit) {
+			reachedFull(state);
 		}
-		break;
-	case Cautious:
-		navHandler.setDestination(state->player->getLocation() - pte * 300);
-		break;
-	case Driveby:
-		Vector2D s = state->player->getLocation() + rotateVector2D(pte * 300, 3.1415 / 2);
-		navHandler.setDestination(s);
-		break;
-	}
-	navHandler.update(state);
-
-	// attacking
-	if ((state->player->getLocation() - navHandler.getLocation()).magnitude() < 500.0) { // if player is close try to attack
-		attackTimer -= state->deltaT;
-		if (attackTimer <= 0) {
-			attackTimer = 0.25;
-			//Vector2D playerDir = (state->player->getLocation() - navHandler.getLocation()).normalize();
-			float lead = state->player->getSpeed().magnitude();
-			Vector2D locSpeed = state->player->getLocation() + ((state->player->getSpeed() * state->deltaT) * lead);
-			Vector2D dir = (locSpeed - getLocation()).normalize();
-			//Vector2D projSpeed = navHandler.getSpeed() + dir * 1000;
-			Vector2D projSpeed = dir * 1000;
-
-			//switch (aimMode)
-			state->projectiles.push_back(new Projectile(navHandler.getLocation(), projSpeed, 16, 0.1));
+		return remainder;
+	}
+	restamp(state, currentStorage + requested);
+	if (currentStorage < storageLimit and currentStorage + requested >= storageLimit) {
+		reachedFull(state);
+	}
+	return 0;
+}
+
+void City::reachedFull(GameState* state) {
+	GameEvent event;
+	event.type = GameEvent::CityFull;
+	event.cityID = cityID;
+	event.amount = storageLimit;
+	event.location = tiedBody->location;
+	state->events.publish(event);
+	if (pcPS > 0) {
+		// there is a full hold to pick up, idle cargo ships should look again
+		state->entities.archetypes[KindCargo].alarmAt = state->worldTime;
+	}
+}
+
+//ProjectilePool
+ProjectilePool::~ProjectilePool() {
+	for (Projectile* projectile : spare) {
+		delete projectile;
+	}
+}
+
+void ProjectilePool::reserve(GameState* state, int count) {
+	spare.reserve(count);
+	state->projectiles.reserve(count);
+	for (int i = (int)(spare.size() + state->projectiles.size()); i < count; i++) {
+		spare.push_back(new Projectile(Vector2D(), Vector2D(), 0, 0));
+	}
+}
+
+Projectile* ProjectilePool::fire(GameState* state, Vector2D location, Vector2D direction, float hitRange, float grace) {
+	Projectile* projectile;
+	if (spare.empty()) {
+		projectile = new Projectile(location, direction, hitRange, grace);
+	}
+	else {
+		projectile = spare.back();
+		spare.pop_back();
+		*projectile = Projectile(location, direction, hitRange, grace);
+	}
+	state->projectiles.push_back(projectile);
+	return projectile;
+}
+
+//Playership
+bool PlayerShip::lockonClosest(GameState* state, float maxRange) {
+	float dist = -1;
+	EntityRef entToLock;
+	for (int k = 0; k < KINDCOUNT; k++) {
+		EntityArchetype& archetype = state->entities.archetypes[k];
+		for (int i = 0; i < archetype.size(); i++) {
+			float curDist = (getLocation() - archetype.location[i]).magnitude();
+			if (curDist > maxRange and maxRange != 0) {
+				continue;
+			}
+			if ((curDist < dist) or (dist == -1)) {
+				entToLock = state->entities.refAt(k, i);
+			}
 		}
 	}
+	if (!entToLock.valid()) {
+		entityLockedOn = EntityRef();
+		return false;
+	}
+	entityLockedOn = entToLock;
+	return true;
 }
\ No newline at end of file
@@ -8,32 +8,68 @@
 #include <math.h>
 
 #include "BSLA.h"
+#include "BSLALanes.h"
+#include "Events.h"
+#include "Entities.h"
+#include "AIScheduler.h"
+#include "SpatialIndex.h"
+#include "NBody.h"
+#include "Market.h"
+#include "Profiler.h"
 
 struct GameState;
 class Body;
 class DynamicGravBody;
 class StaticGravBody;
 class City;
-class NavigationObject;
 class PlayerShip;
-class Entity;
-class EntityCargo;
-class EntityPirate;
 class Projectile;
+class WorldGenerator;
 
 static const double GCONST = 2000.0; // Gravity constant
 static const double AREASIZE = 8000; // the size of an area
+static const int PROJECTILEPOOLSTART = 2048; // projectiles made with a world, more than ten seconds of firing every tick
+static const double CLEARANCEHORIZON = 0.5; // seconds a clearance reaches ahead at most, the dynamic bodies' speed bound only holds that long
+
+// rand() and srand() for one world. Worlds are ticked side by side (sectors, the batch runner) so each keeps its own
+// state. It is the same generator as MSVC's rand so a seed still builds the world it always has.
+class WorldRandom {
+private:
+	unsigned int state = 1;
+public:
+	static const int MAX = 32767;
+	void seed(unsigned int newSeed) { state = newSeed; }
+	int next() {
+		state = state * 214013u + 2531011u;
+		return (int)((state >> 16) & MAX);
+	}
+};
+
+// Bits for the sides of an area, see GameState::openBorders.
+enum SectorSide { SideLeft = 1 << 0, SideRight = 1 << 1, SideTop = 1 << 2, SideBottom = 1 << 3 };
+
+// One system of a play area before it is built.
+struct SystemSite {
+	Vector2D location;
+	int seed = 0;
+};
 
 // See GameData.cpp for descriptions.
-double calcGravity(double mass, double distance);
+simScalar calcGravity(simScalar mass, simScalar distance);
 Vector2D getOrbitSpeed(Body* toOrbit, Vector2D myLocation);
 Vector2D doGravity(GameState* state, Vector2D location);
 Body* willCollide(GameState* state, Vector2D location);
+double bodyClearance(GameState* state, Vector2D location, double speed);
 Body* closestToPoint(GameState* state, Vector2D location);
-void generatePlaySpace(double systemRad, double systemPad, int seed, GameState* state);
+void refreshBodyLanes(GameState* state);
+void playSpaceSystems(double systemRad, double systemPad, int seed, double areaSize, std::vector<SystemSite>& out);
+void generatePlaySpace(double systemRad, double systemPad, int seed, GameState* state, double areaSize = AREASIZE);
+void populatePlaySpace(GameState* state, bool startCities = true);
 void randSystemAt(Vector2D location, int seed, GameState* state, double systemRadius);
+GameState* makeHeadlessWorld(int seed);
 void resetGameState(GameState* state);
 double randBodyOrbiting(Body* toOrbit, int seed, GameState* state, double distance, double maxRadius);
+void randClusterAt(Vector2D location, int seed, GameState* state, int bodyCount, double clusterRadius);
 
 // taylor series approx of Sin and Cos derivative.
 // These are included for ease of access when using function based acceleration for a DynamicGravBody.
@@ -42,6 +78,52 @@ static std::vector<double> tayloyDCos = { 0, -1.0, 0, 1.0 / 6, 0, -1.0 / 120, 0,
 
 enum Stage {StageStart, StagePlay, StateMenu};
 
+// Every body's position, speed and size in SoA arrays so the physics can run a lane pack of bodies at a time.
+// Static bodies are in [0, staticEnd) and dynamic bodies in [dynamicStart, dynamicEnd), each range is padded
+// to a whole number of lanes with massless, sizeless bodies far outside the play area.
+struct BodyLanes {
+	int staticEnd = 0;
+	int dynamicStart = 0;
+	int dynamicEnd = 0;
+	int bodyCount = 0; // bodies when last refreshed, a change means clearances worked out before no longer hold
+	simScalar maxDynamicSpeed = 0; // of any dynamic body, for bounding how far they move
+	simScalar maxDynamicAccel = 0; // of any dynamic body over its last update, for bounding how far they turn
+	std::vector<simScalar> x, y, speedX, speedY, radius, mass;
+	std::vector<Body*> bodies; // nullptr for padding
+};
+
+// Projectiles that hit or ran out, kept to be fired again so shooting does not allocate once play has warmed up.
+class ProjectilePool {
+private:
+	std::vector<Projectile*> spare;
+public:
+	~ProjectilePool();
+	// Makes spare projectiles until count are in flight or spare, and sizes both lists to hold them.
+	void reserve(GameState* state, int count);
+	// A projectile set up as new Projectile(location, direction, hitRange, grace) would be, added to state->projectiles.
+	Projectile* fire(GameState* state, Vector2D location, Vector2D direction, float hitRange, float grace);
+	// Takes back a projectile that has been removed from state->projectiles.
+	void release(Projectile* projectile) { spare.push_back(projectile); }
+};
+
+// When cities will fill up, soonest first, so the tick only visits the cities that just did.
+class CitySchedule {
+private:
+	struct Entry {
+		double time;
+		City* city;
+		int version; // the city's scheduleVersion when added
+		bool operator<(const Entry& other) const { return time > other.time; } // a min heap through std::push_heap
+	};
+	std::vector<Entry> heap;
+public:
+	void add(double time, City* city, int version);
+	// Tells every city whose time has come that it is full, entries from before a city last changed are skipped.
+	void run(GameState* state);
+	void clear() { heap.clear(); }
+	int size() { return (int)heap.size(); }
+};
+
 // This structure contains all data needed to run the game
 struct GameState {
 	Stage curState;
@@ -52,16 +134,25 @@ struct GameState {
 	int seed;
 	int entityCap;
 	float deltaT;
-	PlayerShip* player;
+	double worldTime = 0; // seconds this world has been played for, the clock cities work their storage out from
+	PlayerShip* player; // nullptr in a sector the player is not in, see Sectors.h
+	unsigned char openBorders = 0; // SectorSide bits that lead into a neighbouring sector rather than stopping things
 	std::string seedStringBuffer;
 	std::vector<StaticGravBody*> staticGravBodies;
 	std::vector<DynamicGravBody*> dynamicGravBodies;
-	std::vector<Entity*> entities;
+	EntityWorld entities;
 	std::vector<City*> cities;
+	CitySchedule citySchedule; // when the producing cities fill up, see City
+	Market market; // the goods cities make, use and trade, built from cities
 	std::vector<Projectile*> projectiles;
-	// events should never be used for important pieces of game control (exiting, saving, ect)
-	// only for things that could be thrown away when the stack clears.
-	std::vector<std::string> eventStack;
+	ProjectilePool projectilePool; // fire new projectiles through this rather than new
+	SpatialIndex spatialIndex; // rebuilt at the end of every update
+	BodyLanes bodyLanes; // refreshed by update before and after the bodies move
+	EventBus events; // dispatched once per update, see Events.h
+	WorldRandom random; // every random choice made building and updating this world
+	NBodySystem nbody; // moves the moveType 4 bodies, see NBody.h
+	AIScheduler ai; // picks which entities think each tick
+	WorldGenerator* generator = nullptr; // still building this world in the background, see WorldGen.h
 };
 
 // The base parent class for physical bodies, represents planets, suns, etc.
@@ -69,8 +160,8 @@ class Body {
 public:
 	Vector2D speed = Vector2D(0, 0);
 	Vector2D location = Vector2D(0, 0);
-	double radius = 0;
-	double mass = 0;
+	simScalar radius = 0;
+	simScalar mass = 0;
 	int bodyID = -1;
 	char bodyType; // p planet s star
 };
@@ -81,9 +172,11 @@ public:
 // 1 sets the speed to maintain an eliptical orbit about a point (with cos and sin).
 // 2 for a following function vectors to set speed,
 // 3 for set speed impacted by gravity (with collision).
+// 4 for mutual gravity with the other moveType 4 bodies, moved by GameState::nbody rather than update (no collision).
 class DynamicGravBody : public Body {
 public:
-	Vector2D gravDelta;
+	Vector2D gravDelta; // moveType 3 the speed gravity added, moveType 4 the acceleration
+	Vector2D lastAccel; // how fast speed changed over the last update, any moveType
 
 	// Each of these values impact each moveType in a different way.
 	// look close at the update function to see how they affect the body.
@@ -109,6 +202,7 @@ public:
 		timetart = tstart; timeEnd = tend; deltaMul = dm; XMul = xm; YMul = ym;
 	}
 	void update(GameState* state) {
+		Vector2D pastSpeed = speed;
 		// iterate the current time.
 		timeCur += state->deltaT * deltaMul;
 		if (timeCur > timeEnd) {
@@ -173,11 +267,17 @@ public:
 			
 		}
 		break;
+		case 4:
+			// Moved with every other member by NBodySystem::step.
+			return;
 		default:
 		break;
 		}
 
 		location = location + (speed * state->deltaT);
+		if (state->deltaT > 0) {
+			lastAccel = (speed - pastSpeed) * (1 / state->deltaT);
+		}
 	}
 };
 
@@ -192,13 +292,18 @@ public:
 	}
 };
 
+// Storage changes in a straight line at pcPS until it reaches 0 or the limit, so it is kept as the amount at a time
+// and worked out for whenever it is asked for. Nothing is done per tick, the CitySchedule wakes a city that fills up.
 class City {
 protected:
 	float pcPS = 1; // produce or consume per second
 	float storageLimit = 100;
-	float currentStorage = 0;
+	float storedAmount = 0; // storage at storedAt
+	double storedAt = 0; // GameState::worldTime
+	int scheduleVersion = 0; // bumped whenever the line changes, older CitySchedule entries are stale
 	int cityID = -1;
 	Body* tiedBody = nullptr;
+	void restamp(GameState* state, float amount);
 public:
 	City(float pcps, int sl, int id, Body* tb) {
 		pcPS = pcps;
@@ -208,245 +313,25 @@ public:
 	}
 	float getpcPS() { return pcPS; }
 	float getStorageLimit() { return storageLimit; }
-	float getCurStorage() { return currentStorage; }
+	// Storage at a time on the world clock, now or a predicted time ahead.
+	float getCurStorage(double now) {
+		double storage = storedAmount + pcPS * (now - storedAt);
+		return (float)fmax(0, fmin(storageLimit, storage));
+	}
+	// When storage reaches the limit or 0 if nothing is taken or given before then, infinity if it never will.
+	double fullAt() { return pcPS > 0 ? storedAt + (storageLimit - storedAmount) / pcPS : INFINITY; }
+	double emptyAt() { return pcPS < 0 ? storedAt + storedAmount / -pcPS : INFINITY; }
 	int getID() { return cityID; }
+	int getScheduleVersion() { return scheduleVersion; }
 	Body* getTiedBody() { return tiedBody; }
-	float take(float requested) { // returns how much was taken
-		if (requested >= currentStorage) {
-			int temp = currentStorage;
-			currentStorage = 0;
-			return temp;
-		}
-		currentStorage -= requested;
-		return requested;
-	}
-	float give(float requested) { // returns the the remainder
-		if (currentStorage + requested > storageLimit) {
-			int remainder = storageLimit - (currentStorage + requested);
-			currentStorage = storageLimit;
-			return remainder;
-		}
-		currentStorage += requested;
-		return 0;
-	}
-	void update(GameState* state) {
-		currentStorage += pcPS * state->deltaT;
-		if (currentStorage > storageLimit) {
-			currentStorage = storageLimit;
-		}
-		if (currentStorage < 0) {
-			currentStorage = 0;
-		}
-	}
-};
-
-
-// TODO: this class is being experimented with and is subject to frequent changes
-// The class represting things that navigate the a world of bodies.
-class NavigationObject {
-protected:
-	Vector2D location = Vector2D(0, 0);
-	Vector2D destination = Vector2D(0, 0);
-	Vector2D start = location;
-	Vector2D currentDest = destination;
-	Vector2D speed = Vector2D(0, 0);
-	double impulseSpeed;
-public:
-	Body* closestBody = nullptr;
-	Vector2D getSpeed() { return speed; }
-	Vector2D getLocation() { return location; }
-	Vector2D getD() { return destination; }
-	Vector2D getCD() { return currentDest; }
-	void forceLocation(Vector2D newLoc) { location = newLoc; }
-	void setDestination(Vector2D dest) { destination = dest; }
-	void avoidBodies(GameState* state) {
-		// Body Avoidance
-		// draw a line from location to destination. if a body intersects the line add a vertex away from it as a temp destination
-		// check to see if a body intersects by projecting the distance and seeing if that point is within the body radius
-		/*
-					Body
-				   /  '
-		dVect ->  /   '
-				 /    ' <- C -> B (distB)
-				/     '
-			   /	  '
-			  A ------------------ B <- line from location to destination (lineVect)
-			  A ----- C <- projection of A -> Body onto A -> B (lineVecrProj)
-		*/
-		currentDest = destination;
-		double closestDist = -1;
-		closestBody = nullptr;
-		
-		Vector2D lineVect = destination - location;
-		Vector2D closestCBody;
-		bool closestBehind = false;
-		for (auto body : state->staticGravBodies) {
-			// if the destination is in a body, go there anyway
-			if ((destination - body->location).magnitude() <= body->radius) {
-				continue;
-			}
-
-			Vector2D dVect = body->location - location;
-			Vector2D lineVecrProj;
-			lineVecrProj = dVect.proj(lineVect);
-			Vector2D C = lineVecrProj + location; // the location of C
-			double distB = (body->location - C).magnitude();
-
-			// This method will consider bodies that are "Behind the body" thus those need to be passed over
-			// A body is in front if lineVecrProj and lineVect have the same normal (or the same signs for x and y)
-			if (std::signbit(lineVecrProj.x) != std::signbit(lineVect.x) and std::signbit(lineVecrProj.y) != std::signbit(lineVect.y)){
-				continue;
-			}
-			// We also should not concider bodies that are further than B
-			//if (lineVecrProj.magnitude() > lineVect.magnitude()) {
-			if (lineVecrProj.cmpMag(lineVect)){
-				continue;
-			}
-			if (distB <= body->radius + 10) {
-				if (closestDist == -1 or lineVecrProj.magnitude() < closestDist) {
-					closestDist = lineVecrProj.magnitude();
-					closestBody = body;
-					closestCBody = (body->location - C);
-					
-				}
-			}
-		}
-		for (auto body : state->dynamicGravBodies) { // The exact same code as above
-			if ((destination - body->location).magnitude() <= body->radius) {
-				continue;
-			}
-
-			Vector2D dVect = body->location - location;
-			Vector2D lineVecrProj;
-			lineVecrProj = dVect.proj(lineVect);
-			Vector2D C = lineVecrProj + location;
-			double distB = (body->location - C).magnitude();
-			if (std::signbit(lineVecrProj.x) != std::signbit(lineVect.x) and std::signbit(lineVecrProj.y) != std::signbit(lineVect.y)) {
-				continue;
-			}
-			if (lineVecrProj.cmpMag(lineVect)) {
-				continue;
-			}
-			if (distB <= body->radius + 10) {
-				if (closestDist == -1 or lineVecrProj.magnitude() < closestDist) {
-					closestDist = lineVecrProj.magnitude();
-					closestBody = body;
-					closestCBody = (body->location - C);
-				}
-			}
-		}
-		if (closestBody != nullptr) {
-			if (closestCBody == Vector2D(0, 0)) {
-				Vector2D avoidVect = (closestBody->location - location).normalize();
-				avoidVect = Vector2D(-avoidVect.y, avoidVect.x);
-				avoidVect = avoidVect * -(closestBody->radius + 60);
-				currentDest = closestBody->location + avoidVect;
-			}
-			else {
-				currentDest = closestBody->location + (closestCBody.normalize() * -(closestBody->radius + 60));
-			}
-		}
-	}
-	void update(GameState* state) {
-		/*
-		* The current avoidance and speed system is not perfect, some collisions still happen
-		* but I feel they are reasonable.
-		*/
-		Vector2D newSpeed = speed;
-		Vector2D gravVect = (doGravity(state, location) * state->deltaT);
-		newSpeed = newSpeed + gravVect;
-
-		// Temporary testing code just to see the object move
-		// get a random body to use for a new destination
-		if ((destination - location).magnitude() < 18) {
-			int randIndex = rand() % (state->staticGravBodies.size() - 1);
-			StaticGravBody* bod = state->staticGravBodies.at(randIndex);
-			Vector2D pVect = Vector2D(rand(), rand());
-			pVect = pVect.normalize();
-			pVect = pVect * (bod->radius + 100);
-			pVect = pVect + bod->location;
-
-			start = destination;
-			destination = pVect;
-		}
-
-		// Run the avoid bodies function to get the current destination
-		avoidBodies(state);
-
-		impulseSpeed = 20;
-		Vector2D locationAsIs = location + (newSpeed * state->deltaT);
-		// if moving forward is worse thank brakeing
-		Vector2D locationWithBrake = location + ((newSpeed * 0.9) * state->deltaT);
-		if ((currentDest - locationAsIs).cmpMag(currentDest - locationWithBrake)) {
-			newSpeed = newSpeed * 0.9;
-		}
-
-		// if the current speed gets close to currentDest do not add an impulse to speed
-		Vector2D speedWithImpulse = newSpeed + ((currentDest - location).normalize() * impulseSpeed);
-		Vector2D locationWithImpulse = location + (speedWithImpulse * state->deltaT);
-		if ((currentDest - locationAsIs).cmpMag(currentDest - locationWithImpulse)) { // is the locationAsIs worse than locationWithImpulse
-			newSpeed = speedWithImpulse;
-			// The limit is to prevent zigzagging
-			if (abs(newSpeed.x) < impulseSpeed / 4) {
-				newSpeed.x = 0;
-			}
-			if (abs(newSpeed.y) < impulseSpeed / 4) {
-				newSpeed.y = 0;
-			}
-		}
-
-		Vector2D dtSpeed = (newSpeed * state->deltaT);
-		Body* collided = willCollide(state, location + Vector2D(dtSpeed.x, dtSpeed.y));
-		if (collided != nullptr) { // A body was collided with
-			Vector2D n;
-			Vector2D relativeSpeed = newSpeed - collided->speed;
-			n = location - collided->location;
-			n = n * (1 / n.magnitude());
-
-			newSpeed = newSpeed * 0.75; // a little friction
-			double impulse = relativeSpeed.dot(n) * -(1.5);
-			newSpeed = newSpeed + (n * impulse);
-		}
-
-		// cap the new speed
-		if (newSpeed.x > 800) {
-			newSpeed.x = 800;
-		}
-		if (newSpeed.x < -800) {
-			newSpeed.x = -800;
-		}
-		if (newSpeed.y > 800) {
-			newSpeed.y = 800;
-		}
-		if (newSpeed.y < -800) {
-			newSpeed.y = -800;
-		}
-
-		speed = newSpeed;
-
-		// change location by speed
-		location = location + (speed * state->deltaT);
-
-		if (location.x < -AREASIZE) {
-			location.x = -AREASIZE;
-			speed.x = 0;
-		}
-		if (location.x > AREASIZE) {
-			location.x = AREASIZE;
-			speed.x = 0;
-		}
-		if (location.y < -AREASIZE) {
-			location.y = -AREASIZE;
-			speed.y = 0;
-		}
-		if (location.y > AREASIZE) {
-			location.y = AREASIZE;
-			speed.y = 0;
-		}
-	}
+	// Starts the city's storage line on the state's clock, for a new city or one moved into another GameState.
+	void startAt(GameState* state) { restamp(state, storedAmount); }
+	float take(GameState* state, float requested); // returns how much was taken
+	float give(GameState* state, float requested); // returns the the remainder
+	// Called by the CitySchedule when storage reaches the limit.
+	void reachedFull(GameState* state);
 };
 
-// The class representing the player and their ship.
 class PlayerShip {
 private:
 	int health = 10;
@@ -463,14 +348,24 @@ private:
 	Body* parkedOn = nullptr;
 	Vector2D parkedDifference;
 	Body* lastCollided = nullptr;
-	Entity* entityLockedOn = nullptr;
+	EntityRef entityLockedOn;
 	float lockOnLead = 30.0;
+	GravityCache gravity;
 public:
 	int damage(int dam, GameState* state) {
 		health -= dam;
 
+		GameEvent event;
+		event.type = GameEvent::Hit;
+		event.isPlayer = true;
+		event.amount = (float)dam;
+		event.location = location;
+		state->events.publish(event);
+
 		if (health <= 0) {
 			state->resetFlag = true;
+			event.type = GameEvent::Kill;
+			state->events.publish(event);
 		}
 		return health;
 	}
@@ -482,6 +377,7 @@ public:
 	Vector2D getPlayerDelta() { return playerDelta; }
 	bool isMoving() { return moving; }
 	bool isParked() { return parked; }
+	bool isBraking() { return brake; }
 	double getThrust() { return thrust; }
 	void setThrustDir(int thr) { thrustDir = thr; }
 	void doBrake() { brake = true; }
@@ -493,8 +389,21 @@ public:
 		forceLocation(Vector2D(0, 0));
 		speed = Vector2D(0, 0);
 		thrust = 1000.0;
+		gravity.invalidate();
+	}
+	// Moves the player into a neighbouring sector, offset takes the location into its coordinates.
+	// Everything held from the old sector is let go as it does not exist in the new one.
+	void crossBorder(Vector2D offset) {
+		location = location + offset;
+		parked = false;
+		parkedOn = nullptr;
+		lastCollided = nullptr;
+		unlockLockon();
+		gravity.invalidate();
 	}
-	Entity* getLockedOn() {
+	// For when bodies are added around the player.
+	void invalidateGravity() { gravity.invalidate(); }
+	EntityRef getLockedOn() {
 		return entityLockedOn;
 	}
 	void incrementLockLead(float val) { 
@@ -507,7 +416,8 @@ public:
 		}
 	}
 	bool lockonClosest(GameState* state, float maxRange);
-	void unlockLockon() { entityLockedOn = nullptr; }
+	void lockOn(EntityRef entity) { entityLockedOn = entity; }
+	void unlockLockon() { entityLockedOn = EntityRef(); }
 	void incrementThrust(double incr) {
 		thrust += incr;
 		if (thrust > 4000) {
@@ -537,7 +447,7 @@ public:
 			parked = false;
 		}
 		if (!parked) {
-			gravDelta = doGravity(state, location);
+			gravDelta = gravity.get(state, location);
 			Vector2D newSpeed = speed;
 			if (!brake) {
 				newSpeed = newSpeed + (playerDelta * state->deltaT);
@@ -626,20 +536,20 @@ public:
 			location = location + (speed * state->deltaT);
 		}
 
-		// Stop the player of they would go over the AREASIZE
-		if (location.x < -AREASIZE) {
+		// Stop the player of they would go over the AREASIZE, unless there is another sector there
+		if (location.x < -AREASIZE and !(state->openBorders & SideLeft)) {
 			location.x = -AREASIZE;
 			speed.x = 0;
 		}
-		if (location.x > AREASIZE) {
+		if (location.x > AREASIZE and !(state->openBorders & SideRight)) {
 			location.x = AREASIZE;
 			speed.x = 0;
 		}
-		if (location.y < -AREASIZE) {
+		if (location.y < -AREASIZE and !(state->openBorders & SideTop)) {
 			location.y = -AREASIZE;
 			speed.y = 0;
 		}
-		if (location.y > AREASIZE) {
+		if (location.y > AREASIZE and !(state->openBorders & SideBottom)) {
 			location.y = AREASIZE;
 			speed.y = 0;
 		}
@@ -647,143 +557,6 @@ public:
 
 };
 
-// An entity is much like a player
-// much of it's movement is handled by a Navigation Object.
-class Entity {
-protected:
-	char faction = 'n'; // no faction
-	char entityType;
-	int health = 10;
-	bool cleanMe = false;
-	NavigationObject navHandler;
-public:
-	Entity() {
-		entityType = 'b';
-	}
-	Entity(char type) {
-		entityType = type;
-	}
-	char getFaction() { return faction; }
-	bool isToClean() { return cleanMe; }
-	char getType() { return entityType; }
-	int damage(int dam, GameState* state) {
-		if (cleanMe) {
-			return 0;
-		}
-		health -= dam;
-
-		if (health <= 0) {
-			cleanMe = true;
-
-			std::string address = std::to_string((std::uintptr_t)this);
-			state->eventStack.push_back("Event: entity " + address + " killed");
-		}
-		return health;
-	}
-	Vector2D getLocation() { return navHandler.getLocation(); }
-	NavigationObject* getNav() { return &navHandler; }
-	int getHealth() { return health; }
-	void setHealth(int h) { health = h; }
-	void update(GameState* state) {
-		if (cleanMe) {
-			return;
-		}
-
-		navHandler.update(state);
-	}
-};
-
-// An entity that brings supplies from producer to consumer cities;
-// Should this project ever introduce parallelization there will likely be issues here.
-class EntityCargo: Entity {
-protected:
-	int cargoCount  = 0;
-	int cargoCap = 10;
-	City* destCity = nullptr;
-public:
-	EntityCargo() {
-		entityType = 'c';
-	}
-	void update(GameState* state) {
-		if (cleanMe) {
-			return;
-		}
-;		if (destCity == nullptr) {
-			if (cargoCount >= cargoCap) {
-				destCity = getBestConsumer(state);
-			}
-			else {
-				destCity = getBestProducer(state);
-			}
-		} else if ((navHandler.getLocation() - destCity->getTiedBody()->location).magnitude() <= destCity->getTiedBody()->radius + 100) { // take or supply the city if close by
-			if (destCity->getpcPS() > 0) {
-				cargoCount = destCity->take(cargoCap);
-				destCity = getBestConsumer(state);
-			}
-			else {
-				cargoCount = destCity->give(cargoCap);
-				destCity = getBestProducer(state);
-			}
-		}
-		
-		
-		if (destCity != nullptr) {
-			Vector2D destLoc = destCity->getTiedBody()->location;
-			navHandler.setDestination(destLoc);
-		}
-
-		navHandler.update(state);
-	}
-	// checks if a city has the supply to fill to cargoCap
-	City* getBestProducer(GameState* state) {
-		City* closest = nullptr;
-		float closestDis = -1;
-		for (City* city : state->cities) {
-			if (city->getpcPS() > 0 and city->getCurStorage() > 0) { // only producers
-				float distance = (navHandler.getLocation() - city->getTiedBody()->location).magnitude();
-				if (city->getCurStorage() > cargoCap) { // A trip is only worth it if the city can fill the cargo hold
-					if ((closest == nullptr) or (distance < closestDis)) {
-						closest = city;
-						closestDis = distance;
-					}
-				}
-			}
-		}
-		return closest;
-	}
-	City* getBestConsumer(GameState* state) {
-		City* closest = nullptr;
-		float closestDis = -1;
-		for (City* city : state->cities) {
-			if (city->getpcPS() <= 0 and city->getCurStorage() < city->getStorageLimit()) { // only producers
-				float distance = (navHandler.getLocation() - city->getTiedBody()->location).magnitude();
-				if ((closest == nullptr) or (distance < closestDis)) {
-					closest = city;
-					closestDis = distance;
-				}
-			}
-		}
-		return closest;
-	}
-};
-
-class EntityPirate : Entity {
-protected:
-	enum AIBehavior;
-	enum AIBAim;
-	AIBehavior currentBehavior;
-	float attackTimer = 0.25;
-public:
-	enum AIBehavior { Reckless, Cautious, Driveby };
-	enum AIBAim { PoorAim, ExactAim, LeadingAim };
-	EntityPirate(AIBehavior behavior) {
-		currentBehavior = behavior;
-		entityType = 'p';
-		faction = 'e';
-	}
-	void update(GameState* state);
-};
-
 class Projectile {
 protected:
 	Vector2D location;
@@ -792,6 +565,10 @@ protected:
 	float grace = 0.0;
 	float timeLimit = 10.0;
 	bool cullMe = false;
+	// A projectile flies in a straight line and every body moves along its orbit or not much faster than it is going,
+	// so how soon the projectile could first reach one can be worked out ahead and the bodies left alone until then.
+	double bodyCheckAt = 0; // GameState::worldTime
+	int bodyCheckCount = -1; // BodyLanes::bodyCount when bodyCheckAt was worked out
 public:
 	Projectile(Vector2D location, Vector2D direction, float hitRange, float grace) {
 		this->location = location; this->direction = direction; this->hitRange = hitRange;
@@ -814,30 +591,33 @@ public:
 			}
 		}
 		else {
-			if ((state->player->getLocation() - location).magnitude() <= hitRange) {
+			if (state->player != nullptr and (state->player->getLocation() - location).magnitude() <= hitRange) {
 				hitPlayer(state);
 				return 1;
 			}
-			for (auto entity : state->entities) {
-				if ((location - entity->getLocation()).magnitude() <= hitRange) {
-					hitEntity(state, entity);
-					return 1;
+			for (int k = 0; k < KINDCOUNT; k++) {
+				EntityArchetype& archetype = state->entities.archetypes[k];
+				for (int i = 0; i < archetype.size(); i++) {
+					if (archetype.dead[i]) {
+						continue;
+					}
+					if ((location - archetype.location[i]).magnitude() <= hitRange) {
+						hitEntity(state, state->entities.refAt(k, i));
+						return 1;
+					}
 				}
 			}
 		}
 
 		// bodies can have a lower hit range
-		for (auto body : state->staticGravBodies) {
-			if ((body->location - location).magnitude() - body->radius <= 0) {
-				hitBody(state);
-				return 1;
-			}
-		}
-		for (auto body : state->dynamicGravBodies) {
-			if ((body->location - location).magnitude() - body->radius <= 0) {
+		if (state->worldTime >= bodyCheckAt or bodyCheckCount != state->bodyLanes.bodyCount) {
+			double clearance = bodyClearance(state, location, direction.magnitude());
+			if (clearance <= 0) {
 				hitBody(state);
 				return 1;
 			}
+			bodyCheckAt = state->worldTime + clearance;
+			bodyCheckCount = state->bodyLanes.bodyCount;
 		}
 
 
@@ -851,9 +631,9 @@ public:
 	void hitBody(GameState* state) {
 		cullMe = true;
 	}
-	void hitEntity(GameState* state, Entity* entity) {
+	void hitEntity(GameState* state, EntityRef entity) {
 		cullMe = true;
-		entity->damage(5, state);
+		damageEntity(state, entity, 5);
 	}
 	void hitPlayer(GameState* state) {
 		// unknown crash sometimes I think it is fixed by moving reset out of playership
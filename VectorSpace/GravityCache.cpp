@@ -0,0 +1,155 @@
+#include "GravityCache.h"
+#include "GameData.h"
+
+static SimLanes absLanes(const SimLanes& value) {
+	return SimLanes::select(value < SimLanes(0), SimLanes(0) - value, value);
+}
+static SimLanes minLanes(const SimLanes& a, const SimLanes& b) {
+	return SimLanes::select(a < b, a, b);
+}
+static simScalar minOfLanes(const SimLanes& value) {
+	simScalar lanes[SimLanes::LANES];
+	value.store(lanes);
+	simScalar lowest = lanes[0];
+	for (int i = 1; i < SimLanes::LANES; i++) {
+		lowest = lanes[i] < lowest ? lanes[i] : lowest;
+	}
+	return lowest;
+}
+
+// Works out the gravity at a location the same way doGravity does, along with its gradient and error terms.
+// Dynamic bodies pull along the signs of the direction to them, so their pull jumps when one lines up with the
+// location on an axis. Those jumps are not smooth so they are bucketed by how far off the line each body is.
+void sampleGravity(GameState* state, Vector2D location, GravitySample& out) {
+	PROFILE_ZONE("sampleGravity");
+	const BodyLanes& lanes = state->bodyLanes;
+	const Vector2DLanes here(location);
+	const SimLanes gConst(GCONST);
+	const SimLanes zero(0); const SimLanes one(1); const SimLanes minusOne(-1);
+	const SimLanes two(2); const SimLanes three(3);
+	Vector2DLanes deltaVec;
+	SimLanes gradXX; SimLanes gradXY; SimLanes gradYX; SimLanes gradYY;
+	SimLanes curvature; SimLanes dynamicSlope;
+	Vector2DLanes drift;
+	SimLanes margin(simScalar(1e15f));
+	SimLanes flips[GRAVFLIPBUCKETS];
+
+	for (int i = 0; i < lanes.staticEnd; i += SimLanes::LANES) {
+		Vector2DLanes locVec = Vector2DLanes::load(&lanes.x[i], &lanes.y[i]) - here;
+		SimLanes distance = locVec.magnitude();
+		SimLanes gravMass = gConst * SimLanes::load(&lanes.mass[i]);
+		SimLanes grav = gravMass / (distance * distance);
+
+		deltaVec = deltaVec + locVec.normalize() * grav;
+
+		// G m (3 d d^T - r^2 I) / r^5
+		SimLanes distanceSquared = distance * distance;
+		SimLanes over5 = gravMass / (distanceSquared * distanceSquared * distance);
+		gradXX = gradXX + (three * locVec.x * locVec.x - distanceSquared) * over5;
+		gradXY = gradXY + three * locVec.x * locVec.y * over5;
+		gradYY = gradYY + (three * locVec.y * locVec.y - distanceSquared) * over5;
+		curvature = curvature + grav / distanceSquared;
+		margin = minLanes(margin, distance - SimLanes::load(&lanes.radius[i]));
+	}
+	gradYX = gradXY;
+	for (int i = lanes.dynamicStart; i < lanes.dynamicEnd; i += SimLanes::LANES) {
+		Vector2DLanes locVec = Vector2DLanes::load(&lanes.x[i], &lanes.y[i]) - here;
+		SimLanes distance = locVec.magnitude();
+		SimLanes gravMass = gConst * SimLanes::load(&lanes.mass[i]);
+		SimLanes grav = gravMass / (distance * distance);
+
+		// Sets vector direction to the sign of each component, a body level with the location pulls nowhere
+		Vector2DLanes direction(
+			SimLanes::select(locVec.x == zero, zero, SimLanes::select(locVec.x < zero, minusOne, one)),
+			SimLanes::select(locVec.y < zero, minusOne, one));
+		direction = Vector2DLanes::select(locVec.y == zero, Vector2DLanes(), direction);
+
+		auto away = distance != zero;
+		deltaVec = Vector2DLanes::select(away, deltaVec + direction * grav, deltaVec);
+
+		// the direction is fixed between flips, only G m / r^2 changes, by 2 G m d / r^4
+		SimLanes distanceSquared = distance * distance;
+		SimLanes over4 = SimLanes::select(away, two * gravMass / (distanceSquared * distanceSquared), zero);
+		gradXX = gradXX + direction.x * locVec.x * over4;
+		gradXY = gradXY + direction.x * locVec.y * over4;
+		gradYX = gradYX + direction.y * locVec.x * over4;
+		gradYY = gradYY + direction.y * locVec.y * over4;
+		// the body moving by v changes its pull like the location moving by -v
+		SimLanes towardSpeed = locVec.dot(Vector2DLanes::load(&lanes.speedX[i], &lanes.speedY[i])) * over4;
+		drift = drift - direction * towardSpeed;
+		curvature = curvature + SimLanes::select(away, grav / distanceSquared, zero);
+		dynamicSlope = dynamicSlope + SimLanes::select(away, grav / distance, zero);
+
+		margin = minLanes(margin, distance - SimLanes::load(&lanes.radius[i]));
+
+		// a flip can change both components by twice the pull, under 3 times its length
+		SimLanes flip = SimLanes::select(away, three * grav, zero);
+		SimLanes toAxis = minLanes(absLanes(locVec.x), absLanes(locVec.y));
+		simScalar within = 1;
+		for (int k = 0; k < GRAVFLIPBUCKETS; k++) {
+			flips[k] = flips[k] + SimLanes::select(toAxis < SimLanes(within), flip, zero);
+			within *= 2;
+		}
+	}
+
+	out.accel = deltaVec.sum();
+	out.gradient = Matrix2D(gradXX.sum(), gradYX.sum(), gradXY.sum(), gradYY.sum());
+	out.drift = drift.sum();
+	out.curvature = curvature.sum();
+	out.dynamicSlope = dynamicSlope.sum();
+	out.margin = minOfLanes(margin);
+	for (int k = 0; k < GRAVFLIPBUCKETS; k++) {
+		out.flips[k] = flips[k].sum();
+	}
+}
+
+/*
+* An upper bound on the extrapolation error once the location and bodies have moved up to relative apart,
+* held while relative is under a quarter of the margin so every body stays at least 3/4 as far as when sampled.
+* The second derivative of G m / r^2 is at most 6 G m / r^4, (4/3)^4 times larger at 3/4 the distance,
+* and half of that times relative^2 is the Taylor remainder. The dynamic bodies are extrapolated in straight lines,
+* turn is how far one could have strayed from that and the pull of each changes by at most 2 sqrt(2) G m / r^3
+* ((4/3)^3 times larger) per unit it strays. On top of that any dynamic body that was lined up within relative
+* may have flipped. Returns -1 when relative is past the last flip bucket.
+*/
+simScalar GravityCache::estimateError(simScalar relative, simScalar turn) const {
+	const simScalar remainder = simScalar(0.5 * 6 * 3.1605); // (4/3)^4
+	const simScalar slope = simScalar(2 * 1.4143 * 2.3704); // (4/3)^3
+	simScalar within = 1;
+	for (int k = 0; k < GRAVFLIPBUCKETS; k++) {
+		if (relative < within) {
+			return remainder * sample.curvature * relative * relative + slope * sample.dynamicSlope * turn + sample.flips[k];
+		}
+		within *= 2;
+	}
+	return -1;
+}
+
+void GravityCache::refresh(GameState* state, Vector2D location) {
+	sampleGravity(state, location, sample);
+	anchor = location;
+	age = 0;
+	tolerance = simScalar(fmax(GRAVCACHEABSOLUTE, GRAVCACHERELATIVE * sample.accel.magnitude()));
+	bound = 0;
+	valid = true;
+	refreshes++;
+}
+
+Vector2D GravityCache::get(GameState* state, Vector2D location) {
+	queries++;
+	age += state->deltaT;
+	Vector2D moved = location - anchor;
+	simScalar distance = moved.magnitude();
+	const BodyLanes& lanes = state->bodyLanes;
+	simScalar turn = simScalar(0.5 * age * age) * lanes.maxDynamicAccel;
+	simScalar relative = distance + lanes.maxDynamicSpeed * simScalar(age) + turn;
+	simScalar error = valid ? estimateError(relative, turn) : -1;
+	if (!valid or age >= GRAVCACHEMAXAGE or distance >= GRAVCACHEMAXDISTANCE
+		or relative * 4 >= sample.margin // a body is passing close by
+		or error < 0 or error > tolerance) {
+		refresh(state, location);
+		return sample.accel;
+	}
+	bound = error;
+	return sample.accel + sample.gradient * moved + sample.drift * simScalar(age);
+}
@@ -0,0 +1,50 @@
+/*
+* Gravity for something that moves a little every tick, like the player or a ship.
+* A full sum over the bodies (see doGravity) is only done now and then, in between the cached value is moved along
+* with the field's gradient. Each refresh also works out how far that can be trusted so the error stays bounded.
+*/
+
+#pragma once
+
+#include "BSLA.h"
+
+struct GameState;
+
+static const double GRAVCACHEMAXAGE = 0.1; // seconds before a full sum no matter what, dynamic bodies are taken to move in straight lines until then
+static const double GRAVCACHEMAXDISTANCE = 100; // world units moved before a full sum no matter what
+static const double GRAVCACHERELATIVE = 0.01; // allowed error as a share of the gravity
+static const double GRAVCACHEABSOLUTE = 0.05; // allowed error where gravity is close to 0
+static const int GRAVFLIPBUCKETS = 9; // bucket k holds the dynamic bodies lined up within 2^k world units
+
+// The gravity at one location as doGravity works it out, and what is needed to extrapolate it.
+struct GravitySample {
+	Vector2D accel;
+	Matrix2D gradient; // accel(location + d) is about accel + gradient * d
+	Vector2D drift; // how accel changes per second as the dynamic bodies move at their current speed
+	simScalar curvature = 0; // sum of G m / r^4, bounds the second order term
+	simScalar dynamicSlope = 0; // sum of G m / r^3 over dynamic bodies, bounds the change from them turning
+	simScalar margin = 0; // how far things can move relative to the bodies before one is reached
+	simScalar flips[GRAVFLIPBUCKETS]; // the most the dynamic bodies in each bucket could change accel by flipping
+};
+void sampleGravity(GameState* state, Vector2D location, GravitySample& out);
+
+class GravityCache {
+private:
+	GravitySample sample;
+	Vector2D anchor; // where sample was taken
+	double age = 0; // seconds since sample was taken
+	simScalar tolerance = simScalar(GRAVCACHEABSOLUTE);
+	simScalar bound = 0; // of the last value returned
+	bool valid = false;
+	void refresh(GameState* state, Vector2D location);
+	simScalar estimateError(simScalar relative, simScalar turn) const;
+public:
+	// The gravity at location, as doGravity would return it give or take errorBound(). Call once per tick.
+	Vector2D get(GameState* state, Vector2D location);
+	// The most the last value from get() is expected to be off by.
+	simScalar errorBound() const { return bound; }
+	// Forces a full sum on the next get(), for when the querier jumps or the bodies are replaced.
+	void invalidate() { valid = false; }
+	int queries = 0;
+	int refreshes = 0;
+};
@@ -0,0 +1,121 @@
+/*
+* Small lock-free containers for passing data between the simulation and render threads.
+*/
+
+#pragma once
+#include <atomic>
+
+/*
+* Three copies of T so a writer and a reader never wait on each other.
+* The writer fills writeBuffer() then publish()es it, the reader calls acquire() and reads readBuffer().
+* A slot is only ever touched by one side at a time, once published it is not written until the reader lets it go.
+*/
+template <typename T>
+class TripleBuffer {
+private:
+	static const int DIRTY = 4; // set on middle when it holds something the reader has not seen
+	T slots[3];
+	std::atomic<int> middle;
+	int back = 0;
+	int front = 2;
+public:
+	TripleBuffer() : middle(1) {}
+	T& writeBuffer() { return slots[back]; }
+	void publish() {
+		back = middle.exchange(back | DIRTY, std::memory_order_acq_rel) & 3;
+	}
+	// Returns true if a newer buffer was swapped in.
+	bool acquire() {
+		if ((middle.load(std::memory_order_relaxed) & DIRTY) == 0) {
+			return false;
+		}
+		front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+		return true;
+	}
+	T& readBuffer() { return slots[front]; }
+};
+
+/*
+* A fixed size single producer single consumer ring.
+* push fails instead of blocking when the ring is full.
+*/
+template <typename T, int SIZE>
+class SPSCQueue {
+private:
+	T ring[SIZE];
+	std::atomic<unsigned int> head; // next slot to read, owned by the consumer
+	std::atomic<unsigned int> tail; // next slot to write, owned by the producer
+public:
+	SPSCQueue() : head(0), tail(0) {}
+	bool push(const T& item) {
+		unsigned int t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) >= SIZE) {
+			return false;
+		}
+		ring[t % SIZE] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+	bool pop(T& item) {
+		unsigned int h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		item = ring[h % SIZE];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+/*
+* A fixed size multiple producer single consumer ring, any thread may push while one thread pops.
+* Each slot carries a sequence number so a producer that has claimed a slot but not finished writing it
+* is never read. push fails instead of blocking when the ring is full. SIZE must be a power of two.
+*/
+template <typename T, int SIZE>
+class MPSCQueue {
+private:
+	struct Slot {
+		std::atomic<unsigned int> seq; // index + 1 once written, index + SIZE once read
+		T item;
+	};
+	Slot ring[SIZE];
+	std::atomic<unsigned int> tail; // next slot to claim, shared by the producers
+	unsigned int head = 0; // next slot to read, owned by the consumer
+public:
+	MPSCQueue() : tail(0) {
+		for (unsigned int i = 0; i < SIZE; i++) {
+			ring[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+	bool push(const T& item) {
+		unsigned int t = tail.load(std::memory_order_relaxed);
+		while (true) {
+			Slot& slot = ring[t % SIZE];
+			int diff = (int)(slot.seq.load(std::memory_order_acquire) - t);
+			if (diff == 0) {
+				if (tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)) {
+					slot.item = item;
+					slot.seq.store(t + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0) {
+				return false; // the consumer has not read this slot yet
+			}
+			else {
+				t = tail.load(std::memory_order_relaxed); // another producer took it
+			}
+		}
+	}
+	bool pop(T& item) {
+		Slot& slot = ring[head % SIZE];
+		if ((int)(slot.seq.load(std::memory_order_acquire) - (head + 1)) < 0) {
+			return false;
+		}
+		item = slot.item;
+		slot.seq.store(head + SIZE, std::memory_order_release);
+		head++;
+		return true;
+	}
+};
@@ -0,0 +1,143 @@
+#include "Market.h"
+#include "GameData.h"
+#include "SeedHash.h"
+
+#include <algorithm>
+
+static MarketLanes maxLanes(const MarketLanes& a, const MarketLanes& b) {
+	return MarketLanes::select(a > b, a, b);
+}
+static MarketLanes minLanes(const MarketLanes& a, const MarketLanes& b) {
+	return MarketLanes::select(a < b, a, b);
+}
+
+void Market::build(GameState* state) {
+	cities = (int)state->cities.size();
+	stride = (MARKETGOODS + MarketLanes::LANES - 1) / MarketLanes::LANES * MarketLanes::LANES;
+	int cells = cities * stride;
+	// padding goods are never made or used, capacity 1 keeps the fill from dividing by 0
+	production.assign(cells, 0);
+	consumption.assign(cells, 0);
+	stock.assign(cells, 0);
+	capacity.assign(cells, 1);
+	price.assign(cells, 0);
+	basePrice.assign(stride, 0);
+	supply.assign(stride, 0); demand.assign(stride, 0);
+	sellShare.assign(stride, 0); buyShare.assign(stride, 0); scarcity.assign(stride, 0);
+	lastTick = state->worldTime;
+	tradedLastTick = 0;
+	valueLastTick = 0;
+
+	for (int g = 0; g < MARKETGOODS; g++) {
+		// hashed rather than drawn from WorldRandom so the rest of the world comes out the same as without a market
+		basePrice[g] = 5 + seedHash(state->seed, -1, g) % 46;
+	}
+	for (int c = 0; c < cities; c++) {
+		int id = state->cities[c]->getID();
+		float* row = &production[c * stride];
+		for (int g = 0; g < MARKETGOODS; g++) {
+			capacity[c * stride + g] = MARKETCAPACITY;
+			stock[c * stride + g] = MARKETCAPACITY * MARKETTARGETFILL;
+			price[c * stride + g] = basePrice[g];
+		}
+		// a good picked twice just gets the larger rate
+		for (int k = 0; k < MARKETMADE; k++) {
+			unsigned int pick = seedHash(state->seed, id, k);
+			int good = pick % MARKETGOODS;
+			row[good] = std::max(row[good], (float)(1 + (pick >> 16) % 3));
+		}
+		for (int k = 0; k < MARKETUSED; k++) {
+			unsigned int pick = seedHash(state->seed, id, MARKETMADE + k);
+			int good = pick % MARKETGOODS;
+			if (row[good] == 0) { // not its own
+				consumption[c * stride + good] = std::max(consumption[c * stride + good], 0.5f + (float)((pick >> 16) % 4) * 0.5f);
+			}
+		}
+	}
+}
+
+void Market::clear() {
+	cities = 0;
+	production.clear(); consumption.clear(); stock.clear(); capacity.clear(); price.clear();
+	tradedLastTick = 0;
+	valueLastTick = 0;
+	lastTick = 0;
+}
+
+void Market::update(GameState* state) {
+	if (cities > 0 and state->worldTime - lastTick >= MARKETTICK) {
+		PROFILE_ZONE("Market::tick");
+		tick(state->worldTime - lastTick);
+		lastTick = state->worldTime;
+	}
+}
+
+void Market::tick(double elapsed) {
+	const MarketLanes dt((float)elapsed);
+	const MarketLanes zero(0);
+	const MarketLanes targetFill(MARKETTARGETFILL);
+	const int width = MarketLanes::LANES;
+	std::fill(supply.begin(), supply.end(), 0.0f);
+	std::fill(demand.begin(), demand.end(), 0.0f);
+
+	// production and consumption, then how much each city has over or under what it wants
+	for (int c = 0; c < cities; c++) {
+		int row = c * stride;
+		for (int g = 0; g < stride; g += width) {
+			int i = row + g;
+			MarketLanes cap = MarketLanes::load(&capacity[i]);
+			MarketLanes held = MarketLanes::load(&stock[i])
+				+ (MarketLanes::load(&production[i]) - MarketLanes::load(&consumption[i])) * dt;
+			held = minLanes(cap, maxLanes(zero, held));
+			held.store(&stock[i]);
+			MarketLanes wanted = cap * targetFill;
+			(MarketLanes::load(&supply[g]) + maxLanes(zero, held - wanted)).store(&supply[g]);
+			(MarketLanes::load(&demand[g]) + maxLanes(zero, wanted - held)).store(&demand[g]);
+		}
+	}
+
+	// clearing, each good trades what can be matched between its sellers and buyers, shared out by how far off each is
+	const MarketLanes tradeShare(MARKETTRADESHARE);
+	const MarketLanes one(1);
+	MarketLanes tradedLanes;
+	MarketLanes valueLanes;
+	for (int g = 0; g < stride; g += width) {
+		MarketLanes offered = MarketLanes::load(&supply[g]);
+		MarketLanes wanted = MarketLanes::load(&demand[g]);
+		MarketLanes traded = minLanes(offered, wanted) * tradeShare;
+		MarketLanes::select(offered > zero, traded / offered, zero).store(&sellShare[g]);
+		MarketLanes::select(wanted > zero, traded / wanted, zero).store(&buyShare[g]);
+		((wanted - offered) / (wanted + offered + one)).store(&scarcity[g]);
+		tradedLanes = tradedLanes + traded;
+		valueLanes = valueLanes + traded * MarketLanes::load(&basePrice[g]);
+	}
+	tradedLastTick = tradedLanes.sum();
+	valueLastTick = valueLanes.sum();
+
+	// the trades, then prices move toward what is left: dear when a city is short and the good is short everywhere
+	const MarketLanes rate(MARKETPRICERATE);
+	const MarketLanes two(2); const MarketLanes slope(1.5f); const MarketLanes half(0.5f);
+	for (int c = 0; c < cities; c++) {
+		int row = c * stride;
+		for (int g = 0; g < stride; g += width) {
+			int i = row + g;
+			MarketLanes cap = MarketLanes::load(&capacity[i]);
+			MarketLanes held = MarketLanes::load(&stock[i]);
+			MarketLanes wanted = cap * targetFill;
+			held = held - maxLanes(zero, held - wanted) * MarketLanes::load(&sellShare[g])
+				+ maxLanes(zero, wanted - held) * MarketLanes::load(&buyShare[g]);
+			held.store(&stock[i]);
+
+			MarketLanes target = MarketLanes::load(&basePrice[g]) * (two - slope * held / cap)
+				* (one + half * MarketLanes::load(&scarcity[g]));
+			MarketLanes current = MarketLanes::load(&price[i]);
+			(current + (target - current) * rate).store(&price[i]);
+		}
+	}
+}
+
+float Market::stockAt(int city, int good, double now) {
+	int i = city * stride + good;
+	float held = stock[i] + (production[i] - consumption[i]) * (float)(now - lastTick);
+	return std::min(capacity[i], std::max(0.0f, held));
+}
@@ -0,0 +1,61 @@
+/*
+* The goods cities make and use, bought and sold between them for money.
+* Every city's production, consumption, stock, capacity and price of every good is one row of dense city x good
+* matrices. Rows are padded to whole lanes so each pass works on MarketLanes::LANES goods at once.
+* The market ticks every MARKETTICK seconds of world time. A tick moves stock on by production and consumption,
+* clears each good between the cities holding more than they want and those holding less, then moves prices toward
+* what the good is worth from what is left. Between ticks stock is worked out from the rates when asked for,
+* the same way City storage is.
+* The supplies the cargo ships carry are still the City's own, see City.
+*/
+
+#pragma once
+#include <vector>
+
+#include "BSLALanes.h"
+
+struct GameState;
+
+typedef ScalarLanes<float> MarketLanes;
+
+static const int MARKETGOODS = 24;
+static const char* const MARKETGOODNAMES[MARKETGOODS] = {
+	"Water", "Food", "Ore", "Ice", "Gas", "Fuel", "Metal", "Alloys",
+	"Polymers", "Silicon", "Electronics", "Machinery", "Parts", "Medicine", "Textiles", "Chemicals",
+	"Luxuries", "Weapons", "Robots", "Seeds", "Livestock", "Spices", "Art", "Data",
+};
+static const double MARKETTICK = 1; // seconds of world time between market ticks
+static const float MARKETCAPACITY = 500; // of each good a city can hold
+static const float MARKETTARGETFILL = 0.5f; // share of capacity a city wants to hold, it sells above and buys below
+static const float MARKETTRADESHARE = 0.2f; // share of what could be matched between sellers and buyers that is, per tick
+static const float MARKETPRICERATE = 0.1f; // how far a price moves toward its target per tick
+static const int MARKETMADE = 2; // goods each city produces
+static const int MARKETUSED = 3; // goods each city consumes
+
+class Market {
+private:
+	int cities = 0;
+	int stride = 0; // floats per row, MARKETGOODS rounded up to whole lanes
+	// cities x stride, row major
+	std::vector<float> production, consumption, stock, capacity, price;
+	// stride, one per good
+	std::vector<float> basePrice;
+	std::vector<float> supply, demand, sellShare, buyShare, scarcity; // worked out each tick
+	double lastTick = 0; // world time stock was last brought up to
+public:
+	// Sizes the matrices for state->cities and picks what each city makes and uses from the world seed.
+	void build(GameState* state);
+	void clear();
+	// Runs a market tick when one is due, call every update.
+	void update(GameState* state);
+	// Moves the whole market on by elapsed seconds.
+	void tick(double elapsed);
+	// City is the index in state->cities.
+	float stockAt(int city, int good, double now);
+	float priceOf(int city, int good) { return price[city * stride + good]; }
+	float productionOf(int city, int good) { return production[city * stride + good]; }
+	float consumptionOf(int city, int good) { return consumption[city * stride + good]; }
+	int cityCount() { return cities; }
+	float tradedLastTick = 0; // goods that changed hands in the last tick
+	float valueLastTick = 0; // what they sold for
+};
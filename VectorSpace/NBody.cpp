@@ -0,0 +1,190 @@
+#include "NBody.h"
+#include "GameData.h"
+
+// Finds the moveType 4 bodies and copies them into the arrays, returns false if there are none.
+// The tiles and accel are only rebuilt when the set of members changed.
+bool NBodySystem::gatherMembers(GameState* state) {
+	int found = 0;
+	bool changed = false;
+	for (DynamicGravBody* body : state->dynamicGravBodies) {
+		if (body->moveType != 4) {
+			continue;
+		}
+		if (found < (int)members.size() and members[found] == body) {
+			found++;
+			continue;
+		}
+		changed = true;
+		members.resize(found);
+		members.push_back(body);
+		found++;
+	}
+	if (found != (int)members.size()) {
+		changed = true;
+		members.resize(found);
+	}
+	count = found;
+
+	if (changed) {
+		int tiles = (count + NBODYTILE - 1) / NBODYTILE;
+		paddedCount = tiles * NBODYTILE;
+		// padding sits far away with no mass so it never pulls
+		const simScalar farAway = 1e15f;
+		x.assign(paddedCount, farAway); y.assign(paddedCount, farAway);
+		speedX.assign(paddedCount, 0); speedY.assign(paddedCount, 0);
+		mass.assign(paddedCount, 0);
+		accelX.assign(paddedCount, 0); accelY.assign(paddedCount, 0);
+		tileI.clear(); tileJ.clear();
+		for (int t1 = 0; t1 < tiles; t1++) {
+			for (int t2 = t1; t2 < tiles; t2++) {
+				tileI.push_back(t1); tileJ.push_back(t2);
+			}
+		}
+		primed = false;
+	}
+	for (int i = 0; i < count; i++) {
+		DynamicGravBody* body = members[i];
+		x[i] = body->location.x; y[i] = body->location.y;
+		speedX[i] = body->speed.x; speedY[i] = body->speed.y;
+		mass[i] = body->mass;
+	}
+	return count > 0;
+}
+
+// Every pair between two different tiles, each pull is added to the body in tile1 and taken from the one in tile2.
+void NBodySystem::pairTile(int tile1, int tile2, simScalar* outX, simScalar* outY) {
+	const int width = SimLanes::LANES;
+	const SimLanes gConst(GCONST);
+	const SimLanes softening(NBODYSOFTENING * NBODYSOFTENING);
+	const SimLanes one(1);
+	int begin1 = tile1 * NBODYTILE; int begin2 = tile2 * NBODYTILE;
+	for (int i = begin1; i < begin1 + NBODYTILE; i++) {
+		const SimLanes xi(x[i]); const SimLanes yi(y[i]);
+		const SimLanes gMassI = gConst * SimLanes(mass[i]);
+		SimLanes sumX; SimLanes sumY;
+		for (int j = begin2; j < begin2 + NBODYTILE; j += width) {
+			SimLanes dx = SimLanes::load(&x[j]) - xi;
+			SimLanes dy = SimLanes::load(&y[j]) - yi;
+			SimLanes distanceSquared = dx * dx + dy * dy + softening;
+			SimLanes inverseCubed = one / (distanceSquared * distanceSquared.sqrt());
+
+			SimLanes pullI = gConst * SimLanes::load(&mass[j]) * inverseCubed;
+			sumX = sumX + dx * pullI; sumY = sumY + dy * pullI;
+
+			SimLanes pullJ = gMassI * inverseCubed;
+			(SimLanes::load(&outX[j]) - dx * pullJ).store(&outX[j]);
+			(SimLanes::load(&outY[j]) - dy * pullJ).store(&outY[j]);
+		}
+		outX[i] += sumX.sum(); outY[i] += sumY.sum();
+	}
+}
+
+// Every pair inside one tile. Each body sums the whole tile for itself, which is simpler to run in lanes than
+// skipping the pairs already seen, and a body's pull on itself is 0 as it is no distance away.
+void NBodySystem::selfTile(int tile, simScalar* outX, simScalar* outY) {
+	const int width = SimLanes::LANES;
+	const SimLanes gConst(GCONST);
+	const SimLanes softening(NBODYSOFTENING * NBODYSOFTENING);
+	const SimLanes one(1);
+	int begin = tile * NBODYTILE;
+	for (int i = begin; i < begin + NBODYTILE; i++) {
+		const SimLanes xi(x[i]); const SimLanes yi(y[i]);
+		SimLanes sumX; SimLanes sumY;
+		for (int j = begin; j < begin + NBODYTILE; j += width) {
+			SimLanes dx = SimLanes::load(&x[j]) - xi;
+			SimLanes dy = SimLanes::load(&y[j]) - yi;
+			SimLanes distanceSquared = dx * dx + dy * dy + softening;
+			SimLanes pull = gConst * SimLanes::load(&mass[j]) / (distanceSquared * distanceSquared.sqrt());
+			sumX = sumX + dx * pull; sumY = sumY + dy * pull;
+		}
+		outX[i] += sumX.sum(); outY[i] += sumY.sum();
+	}
+}
+
+// Sets accel for every member from the other members and the static bodies.
+void NBodySystem::computeAccel(GameState* state) {
+	PROFILE_ZONE("NBodySystem::computeAccel");
+	int workers = pool.workerCount();
+	workerAccelX.resize(workers); workerAccelY.resize(workers);
+	for (int w = 0; w < workers; w++) {
+		workerAccelX[w].assign(paddedCount, 0);
+		workerAccelY[w].assign(paddedCount, 0);
+	}
+
+	// each worker adds into its own arrays so the two bodies of a pair can both be written without locking
+	pool.run((int)tileI.size(), [this](int task, int worker) {
+		simScalar* outX = workerAccelX[worker].data();
+		simScalar* outY = workerAccelY[worker].data();
+		if (tileI[task] == tileJ[task]) {
+			selfTile(tileI[task], outX, outY);
+		}
+		else {
+			pairTile(tileI[task], tileJ[task], outX, outY);
+		}
+	});
+
+	// sum the workers' shares and add the pull of the static bodies, one tile per task
+	const BodyLanes& lanes = state->bodyLanes;
+	pool.run(paddedCount / NBODYTILE, [this, &lanes, workers](int tile, int worker) {
+		const SimLanes gConst(GCONST);
+		const SimLanes softening(NBODYSOFTENING * NBODYSOFTENING);
+		int end = (tile + 1) * NBODYTILE < count ? (tile + 1) * NBODYTILE : count;
+		for (int i = tile * NBODYTILE; i < end; i++) {
+			simScalar sumX = 0; simScalar sumY = 0;
+			for (int w = 0; w < workers; w++) {
+				sumX += workerAccelX[w][i]; sumY += workerAccelY[w][i];
+			}
+			const Vector2DLanes here(Vector2D(x[i], y[i]));
+			Vector2DLanes staticPull;
+			for (int s = 0; s < lanes.staticEnd; s += SimLanes::LANES) {
+				Vector2DLanes toBody = Vector2DLanes::load(&lanes.x[s], &lanes.y[s]) - here;
+				SimLanes distanceSquared = toBody.magnitudeSquared() + softening;
+				SimLanes pull = gConst * SimLanes::load(&lanes.mass[s]) / (distanceSquared * distanceSquared.sqrt());
+				staticPull = staticPull + toBody * pull;
+			}
+			Vector2D fromStatics = staticPull.sum();
+			accelX[i] = sumX + fromStatics.x; accelY[i] = sumY + fromStatics.y;
+		}
+	});
+}
+
+void NBodySystem::step(GameState* state) {
+	PROFILE_ZONE("NBodySystem::step");
+	if (!gatherMembers(state)) {
+		return;
+	}
+	if (count >= NBODYTHREADMIN and !pool.isStarted()) {
+		int threads = (int)std::thread::hardware_concurrency() - 1;
+		if (threads > 0) {
+			pool.start(threads);
+		}
+	}
+	if (!primed) {
+		computeAccel(state);
+		primed = true;
+	}
+
+	// velocity Verlet, half a kick with the old accel, a full drift, then half a kick with the new accel
+	simScalar dt = state->deltaT;
+	simScalar halfDt = dt / 2;
+	for (int i = 0; i < count; i++) {
+		speedX[i] += accelX[i] * halfDt; speedY[i] += accelY[i] * halfDt;
+		x[i] += speedX[i] * dt; y[i] += speedY[i] * dt;
+	}
+	computeAccel(state);
+	for (int i = 0; i < count; i++) {
+		speedX[i] += accelX[i] * halfDt; speedY[i] += accelY[i] * halfDt;
+		DynamicGravBody* body = members[i];
+		body->location = Vector2D(x[i], y[i]);
+		body->speed = Vector2D(speedX[i], speedY[i]);
+		body->gravDelta = Vector2D(accelX[i], accelY[i]);
+		body->lastAccel = body->gravDelta;
+	}
+}
+
+void NBodySystem::clear() {
+	members.clear();
+	count = 0;
+	paddedCount = 0;
+	primed = false;
+}
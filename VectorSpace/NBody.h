@@ -0,0 +1,43 @@
+/*
+* Mutual gravity for DynamicGravBody moveType 4.
+* Every member pulls on every other member and is pulled by the static bodies. Each pair's force is worked out once
+* and applied to both bodies (Newton's third law), in tiles of bodies small enough to stay in cache, spread over a
+* WorkerPool. Members are moved with velocity Verlet (kick, drift, kick) so orbits keep their energy over long runs
+* instead of slowly spiraling the way speed += gravity; location += speed does.
+*/
+
+#pragma once
+#include <vector>
+
+#include "BSLA.h"
+#include "WorkerPool.h"
+
+struct GameState;
+class DynamicGravBody;
+
+static const int NBODYTILE = 64; // bodies per tile, a whole number of lane packs
+static const double NBODYSOFTENING = 25; // keeps close passes from flinging bodies, in world units
+static const int NBODYTHREADMIN = 256; // members needed before the work is spread over threads
+
+class NBodySystem {
+private:
+	std::vector<DynamicGravBody*> members;
+	int count = 0;
+	int paddedCount = 0; // count rounded up to whole tiles, the padding has no mass
+	std::vector<simScalar> x, y, speedX, speedY, mass;
+	std::vector<simScalar> accelX, accelY; // at the current positions
+	std::vector<std::vector<simScalar>> workerAccelX, workerAccelY; // each worker's share before summing
+	std::vector<int> tileI, tileJ; // the tile pairs, each is one task
+	bool primed = false; // accel matches the current members
+	WorkerPool pool;
+
+	bool gatherMembers(GameState* state);
+	void computeAccel(GameState* state);
+	void pairTile(int tile1, int tile2, simScalar* outX, simScalar* outY);
+	void selfTile(int tile, simScalar* outX, simScalar* outY);
+public:
+	// Moves every moveType 4 body forward by state->deltaT, run with state->bodyLanes up to date for the statics.
+	void step(GameState* state);
+	int memberCount() { return count; }
+	void clear();
+};
@@ -0,0 +1,221 @@
+#include "Profiler.h"
+
+#ifdef VS_PROFILE
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+// One timed zone, fields are atomics so a reader racing a writer is caught by seq instead of being undefined.
+// seq is odd while the event is being written and 2 * index + 2 once it is complete.
+struct ProfileEvent {
+	std::atomic<unsigned long long> seq;
+	std::atomic<int> zone;
+	std::atomic<int> thread;
+	std::atomic<long long> start;
+	std::atomic<long long> end;
+};
+
+static ProfileEvent ring[Profiler::RINGSIZE];
+static std::atomic<unsigned long long> writeIndex(0);
+static std::atomic<int> threadCount(0);
+
+// stored after zoneCount is bumped, so a zone counted but not yet named reads as null
+static std::atomic<const char*> zoneNames[Profiler::MAXZONES];
+static std::atomic<int> zoneCount(0);
+static std::atomic<long long> frameTotals[Profiler::MAXZONES];
+static std::atomic<int> frameCalls[Profiler::MAXZONES];
+// the last entry is for allocations outside every zone
+static std::atomic<long long> frameAllocations[Profiler::MAXZONES + 1];
+static std::atomic<long long> frameAllocatedBytes[Profiler::MAXZONES + 1];
+static thread_local int currentZone = Profiler::MAXZONES;
+
+// Only touched by the thread calling endFrame (the render thread).
+static double history[Profiler::MAXZONES][Profiler::HISTORY];
+static int lastCalls[Profiler::MAXZONES];
+static long long lastAllocations[Profiler::MAXZONES + 1];
+static long long lastAllocatedBytes[Profiler::MAXZONES + 1];
+static long long frameStarts[Profiler::HISTORY];
+static long long lastFrameEnd = 0;
+static int frameCount = 0;
+
+int Profiler::registerZone(const char* name) {
+	int id = zoneCount.fetch_add(1);
+	if (id >= MAXZONES) {
+		std::cout << "Profiler: too many zones, " << name << " shares the last one\n";
+		return MAXZONES - 1;
+	}
+	zoneNames[id].store(name, std::memory_order_release);
+	return id;
+}
+
+// Lock free, any thread can record at the same time.
+void Profiler::record(int zone, long long start, long long end) {
+	static thread_local int threadID = threadCount.fetch_add(1);
+	unsigned long long index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+	ProfileEvent& event = ring[index & (RINGSIZE - 1)];
+	event.seq.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	event.zone.store(zone, std::memory_order_relaxed);
+	event.thread.store(threadID, std::memory_order_relaxed);
+	event.start.store(start, std::memory_order_relaxed);
+	event.end.store(end, std::memory_order_relaxed);
+	event.seq.store(2 * index + 2, std::memory_order_release);
+
+	frameTotals[zone].fetch_add(end - start, std::memory_order_relaxed);
+	frameCalls[zone].fetch_add(1, std::memory_order_relaxed);
+}
+
+int Profiler::enterZone(int zone) {
+	int previous = currentZone;
+	currentZone = zone;
+	return previous;
+}
+
+void Profiler::leaveZone(int previous) {
+	currentZone = previous;
+}
+
+// Must not allocate itself.
+void Profiler::countAllocation(size_t bytes) {
+	frameAllocations[currentZone].fetch_add(1, std::memory_order_relaxed);
+	frameAllocatedBytes[currentZone].fetch_add((long long)bytes, std::memory_order_relaxed);
+}
+
+void Profiler::lastFrameAllocations(long long& count, long long& bytes) {
+	count = 0;
+	bytes = 0;
+	for (int z = 0; z <= MAXZONES; z++) {
+		count += lastAllocations[z];
+		bytes += lastAllocatedBytes[z];
+	}
+}
+
+// Moves this frame's totals into the history.
+void Profiler::endFrame() {
+	long long time = now();
+	if (lastFrameEnd == 0) {
+		lastFrameEnd = time;
+	}
+	int slot = frameCount % HISTORY;
+	frameStarts[slot] = lastFrameEnd;
+	lastFrameEnd = time;
+
+	int zones = std::min(zoneCount.load(), (int)MAXZONES);
+	for (int z = 0; z < zones; z++) {
+		history[z][slot] = frameTotals[z].exchange(0, std::memory_order_relaxed) / 1000000.0;
+		lastCalls[z] = frameCalls[z].exchange(0, std::memory_order_relaxed);
+	}
+	for (int z = 0; z <= MAXZONES; z++) {
+		lastAllocations[z] = frameAllocations[z].exchange(0, std::memory_order_relaxed);
+		lastAllocatedBytes[z] = frameAllocatedBytes[z].exchange(0, std::memory_order_relaxed);
+	}
+	frameCount++;
+}
+
+// Average and 99th percentile of each zone's time per frame over the history.
+void Profiler::getStats(std::vector<ZoneStats>& out) {
+	out.clear();
+	int zones = std::min(zoneCount.load(), (int)MAXZONES);
+	int frames = std::min(frameCount, (int)HISTORY);
+	if (frames == 0) {
+		return;
+	}
+	double sorted[HISTORY];
+	for (int z = 0; z < zones; z++) {
+		const char* name = zoneNames[z].load(std::memory_order_acquire);
+		if (name == nullptr) {
+			continue;
+		}
+		double sum = 0;
+		for (int f = 0; f < frames; f++) {
+			sorted[f] = history[z][f];
+			sum += sorted[f];
+		}
+		std::sort(sorted, sorted + frames);
+		int p99Index = (frames * 99 + 99) / 100 - 1;
+		ZoneStats stats;
+		stats.name = name;
+		stats.average = sum / frames;
+		stats.p99 = sorted[p99Index];
+		stats.lastCalls = lastCalls[z];
+		stats.lastAllocations = (double)lastAllocations[z];
+		stats.lastAllocatedBytes = (double)lastAllocatedBytes[z];
+		out.push_back(stats);
+	}
+}
+
+// Writes the events of the last frames as Chrome trace event JSON (chrome://tracing or Perfetto).
+// When the ring has already overwritten the start of the oldest frames asked for, only the frames it still holds
+// whole are written and the shortfall is reported.
+bool Profiler::writeChromeTrace(const char* path, int frames) {
+	frames = std::min(std::min(frames, (int)HISTORY), frameCount);
+	if (frames <= 0) {
+		return false;
+	}
+	int asked = frames;
+	unsigned long long newest = writeIndex.load(std::memory_order_acquire);
+	unsigned long long oldest = newest > (unsigned long long)RINGSIZE ? newest - RINGSIZE : 0;
+	if (oldest > 0) {
+		// everything overwritten was recorded, so had ended, before the oldest event left had
+		long long lostBefore = 0;
+		for (unsigned long long index = oldest; index < newest; index++) {
+			ProfileEvent& event = ring[index & (RINGSIZE - 1)];
+			if (event.seq.load(std::memory_order_acquire) == 2 * index + 2) {
+				lostBefore = event.end.load(std::memory_order_relaxed);
+				break;
+			}
+		}
+		while (frames > 0 and frameStarts[(frameCount - frames) % HISTORY] < lostBefore) {
+			frames--;
+		}
+		if (frames <= 0) {
+			std::cout << "Profiler: the ring does not hold a whole frame, nothing written\n";
+			return false;
+		}
+	}
+	long long cutoff = frameStarts[(frameCount - frames) % HISTORY];
+
+	std::ofstream file(path);
+	if (!file) {
+		std::cout << "Profiler: could not open " << path << "\n";
+		return false;
+	}
+	file << "{\"traceEvents\":[\n";
+	bool first = true;
+	int written = 0;
+	for (unsigned long long index = oldest; index < newest; index++) {
+		ProfileEvent& event = ring[index & (RINGSIZE - 1)];
+		unsigned long long seq = event.seq.load(std::memory_order_acquire);
+		int zone = event.zone.load(std::memory_order_relaxed);
+		int thread = event.thread.load(std::memory_order_relaxed);
+		long long start = event.start.load(std::memory_order_relaxed);
+		long long end = event.end.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (seq != 2 * index + 2 or event.seq.load(std::memory_order_relaxed) != seq) {
+			continue; // being written or already replaced
+		}
+		if (start < cutoff or zone < 0 or zone >= MAXZONES) {
+			continue;
+		}
+		const char* name = zoneNames[zone].load(std::memory_order_acquire);
+		if (name == nullptr) {
+			continue;
+		}
+		if (!first) {
+			file << ",\n";
+		}
+		first = false;
+		file << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread
+			<< ",\"ts\":" << (start - cutoff) / 1000.0 << ",\"dur\":" << (end - start) / 1000.0 << "}";
+		written++;
+	}
+	file << "\n]}\n";
+	std::cout << "Profiler: wrote " << written << " events from " << frames << " frames to " << path << "\n";
+	if (frames < asked) {
+		std::cout << "Profiler: only " << frames << " of the " << asked << " frames asked for were still in the ring\n";
+	}
+	return true;
+}
+
+#endif
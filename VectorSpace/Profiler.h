@@ -0,0 +1,81 @@
+/*
+* Scoped timing zones for finding where a frame goes.
+* Only compiled in when VS_PROFILE is defined (Debug builds), otherwise the macros are empty.
+*
+* PROFILE_ZONE("name") times the rest of the enclosing scope.
+* PROFILE_FRAME() is called once per rendered frame to roll the per zone totals into their history.
+* Heap allocations are counted per zone as well, see AllocTracker.h.
+*/
+
+#pragma once
+
+#ifdef VS_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Timing for one zone over the recorded frames, in milliseconds per frame.
+struct ZoneStats {
+	const char* name;
+	double average;
+	double p99;
+	double lastCalls; // times the zone ran last frame
+	double lastAllocations; // heap allocations made inside the zone last frame, not counting the zones inside it
+	double lastAllocatedBytes;
+};
+
+class Profiler {
+public:
+	static const int MAXZONES = 64;
+	// raw events kept for trace export, a power of two. The per entity zones and every sector thread write to it,
+	// so a busy frame takes a few thousand
+	static const int RINGSIZE = 1 << 18;
+	static const int HISTORY = 240; // frames of per zone totals kept for the stats
+
+	static long long now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	static int registerZone(const char* name);
+	static void record(int zone, long long start, long long end);
+	// The zone the calling thread is in, for charging allocations to. Returns the zone it was in before.
+	static int enterZone(int zone);
+	static void leaveZone(int previous);
+	// Called by the replaced operator new, see AllocTracker.h.
+	static void countAllocation(size_t bytes);
+	// Allocations on every thread last frame, inside zones or not.
+	static void lastFrameAllocations(long long& count, long long& bytes);
+	static void endFrame();
+	static void getStats(std::vector<ZoneStats>& out);
+	static bool writeChromeTrace(const char* path, int frames);
+};
+
+// Records the time between construction and destruction into the zone.
+class ProfileScope {
+private:
+	int zone;
+	int previous;
+	long long start;
+public:
+	ProfileScope(int zoneID) : zone(zoneID), previous(Profiler::enterZone(zoneID)), start(Profiler::now()) {}
+	~ProfileScope() {
+		Profiler::record(zone, start, Profiler::now());
+		Profiler::leaveZone(previous);
+	}
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) \
+	static int PROFILE_CONCAT(profileZone, __LINE__) = Profiler::registerZone(name); \
+	ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileZone, __LINE__))
+#define PROFILE_FRAME() Profiler::endFrame()
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_FRAME()
+
+#endif
@@ -0,0 +1,246 @@
+#include "Sectors.h"
+#include "Simulation.h"
+
+// The side of the sector a location has left by, as an index into Sector::neighbors, or -1 if it is inside.
+static int sideLeft(Vector2D location) {
+	if (location.x < -AREASIZE) {
+		return 0;
+	}
+	if (location.x > AREASIZE) {
+		return 1;
+	}
+	if (location.y < -AREASIZE) {
+		return 2;
+	}
+	if (location.y > AREASIZE) {
+		return 3;
+	}
+	return -1;
+}
+
+// What is added to a location to move it across a side into the neighbour's coordinates.
+static Vector2D sideOffset(int side) {
+	switch (side)
+	{
+	case 0:
+		return Vector2D(2 * AREASIZE, 0);
+	case 1:
+		return Vector2D(-2 * AREASIZE, 0);
+	case 2:
+		return Vector2D(0, 2 * AREASIZE);
+	default:
+		return Vector2D(0, -2 * AREASIZE);
+	}
+}
+
+void SectorMap::start(GameState* homeState) {
+	stop();
+	player = homeState->player;
+	int center = SECTORGRID / 2;
+	home = center * SECTORGRID + center;
+	for (int i = 0; i < SECTORGRID * SECTORGRID; i++) {
+		Sector* sector = new Sector;
+		sector->gridX = i % SECTORGRID;
+		sector->gridY = i / SECTORGRID;
+		if (i == home) {
+			sector->state = homeState;
+		}
+		else {
+			GameState* state = makeHeadlessWorld(homeState->seed + (i - home) * SECTORSEEDSTEP);
+			state->debugMode = homeState->debugMode;
+			startWorldGeneration(1000, 500, state->seed, state); // taken in by update as the sector is ticked
+			state->spatialIndex.rebuild(state);
+			sector->state = state;
+		}
+		sectors.push_back(sector);
+	}
+	for (Sector* sector : sectors) {
+		const int stepX[4] = { -1, 1, 0, 0 };
+		const int stepY[4] = { 0, 0, -1, 1 };
+		sector->state->openBorders = 0;
+		for (int side = 0; side < 4; side++) {
+			int x = sector->gridX + stepX[side]; int y = sector->gridY + stepY[side];
+			if (x < 0 or x >= SECTORGRID or y < 0 or y >= SECTORGRID) {
+				continue;
+			}
+			sector->neighbors[side] = sectors[y * SECTORGRID + x];
+			sector->state->openBorders |= 1 << side;
+		}
+	}
+
+	// the simulation and render threads have a core each, the background thread is worker 0
+	int threads = (int)std::thread::hardware_concurrency() - 3;
+	if (threads > (int)sectors.size() - 2) {
+		threads = (int)sectors.size() - 2;
+	}
+	if (threads > 0) {
+		pool.start(threads);
+	}
+	foreground.store(home);
+	claimed.store(-1);
+	paused.store(homeState->gamePause);
+	stopRequested.store(false);
+	background = std::thread(&SectorMap::runBackground, this);
+}
+
+void SectorMap::stop() {
+	if (background.joinable()) {
+		stopRequested.store(true);
+		background.join();
+	}
+	pool.stop();
+	for (Sector* sector : sectors) {
+		sector->state->player = nullptr;
+		if (sectors[home] == sector) {
+			continue;
+		}
+		resetGameState(sector->state);
+		delete sector->state;
+	}
+	if (!sectors.empty()) {
+		GameState* homeState = sectors[home]->state;
+		homeState->player = player;
+		homeState->openBorders = 0;
+		if (homeState->curState == StagePlay) {
+			resetGameState(homeState);
+		}
+	}
+	for (Sector* sector : sectors) {
+		delete sector;
+	}
+	sectors.clear();
+	home = -1;
+	foreground.store(-1);
+}
+
+// One background tick, the same update the foreground runs with no player input.
+void SectorMap::tickSector(Sector* sector, float deltaT) {
+	sector->state->deltaT = deltaT;
+	update(sector->state, 0);
+	exchange(sector);
+}
+
+// The background thread, ticks every sector but the foreground at backgroundRate until stopped.
+void SectorMap::runBackground() {
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	Uint64 tickLength = (Uint64)(frequency / backgroundRate);
+	Uint64 last = SDL_GetPerformanceCounter();
+
+	while (!stopRequested.load(std::memory_order_relaxed)) {
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (now - last < tickLength) {
+			SDL_DelayNS((Uint64)((tickLength - (now - last)) * 1000000000.0 / frequency));
+			continue;
+		}
+		float deltaT = (float)fmin((now - last) / (double)frequency, SECTORMAXDELTAT);
+		last = now;
+		if (paused.load(std::memory_order_relaxed)) {
+			continue;
+		}
+
+		// claim the foreground before reading it back, followPlayer does the opposite so one of them sees the other
+		int skip = foreground.load();
+		claimed.store(skip);
+		if (foreground.load() != skip) {
+			claimed.store(-1);
+			continue;
+		}
+		{
+			PROFILE_ZONE("SectorMap background");
+			pool.run((int)sectors.size(), [this, skip, deltaT](int task, int worker) {
+				if (task != skip) {
+					tickSector(sectors[task], deltaT);
+				}
+			});
+		}
+		claimed.store(-1);
+	}
+}
+
+void SectorMap::exchange(Sector* sector) {
+	PROFILE_ZONE("SectorMap::exchange");
+	GameState* state = sector->state;
+	EntityWorld& entities = state->entities;
+
+	// leaving, only through open sides as navigate keeps entities in on the others
+	for (int k = 0; k < KINDCOUNT; k++) {
+		EntityArchetype& archetype = entities.archetypes[k];
+		for (int i = 0; i < archetype.size(); i++) {
+			int side = sideLeft(archetype.location[i]);
+			if (side < 0 or archetype.dead[i] or sector->neighbors[side] == nullptr) {
+				continue;
+			}
+			Vector2D offset = sideOffset(side);
+			EntityHandoff handoff;
+			handoff.kind = k;
+			handoff.location = archetype.location[i] + offset;
+			handoff.speed = archetype.speed[i];
+			handoff.destination = archetype.navigation[i].destination + offset;
+			handoff.health = archetype.health[i];
+			if (k == KindCargo) {
+				handoff.cargo = archetype.cargo[i];
+				handoff.cargo.destCity = nullptr;
+				handoff.cargo.exporting = false;
+			}
+			if (k == KindPirate) {
+				handoff.brain = archetype.brain[i];
+			}
+			if (sector->neighbors[side]->inbox.push(handoff)) {
+				// its place in this sector's population goes with it
+				entities.kill(entities.refAt(k, i));
+				state->entityCap--;
+			}
+			else {
+				// the neighbour is full, wait at the border and try again next tick
+				archetype.location[i].x = fmax(-AREASIZE, fmin(AREASIZE, archetype.location[i].x));
+				archetype.location[i].y = fmax(-AREASIZE, fmin(AREASIZE, archetype.location[i].y));
+				archetype.speed[i] = Vector2D(0, 0);
+			}
+		}
+	}
+
+	// arriving
+	EntityHandoff handoff;
+	while (sector->inbox.pop(handoff)) {
+		EntityRef ref;
+		if (handoff.kind == KindPirate) {
+			ref = entities.spawnPirate(handoff.brain.behavior, handoff.location, handoff.destination);
+			entities.brain(ref) = handoff.brain;
+		}
+		else {
+			ref = entities.spawnCargo(handoff.location, handoff.destination);
+			entities.cargo(ref) = handoff.cargo;
+		}
+		entities.speed(ref) = handoff.speed;
+		entities.health(ref) = handoff.health;
+		state->entityCap++;
+	}
+}
+
+bool SectorMap::followPlayer() {
+	Sector* from = sectors[foreground.load()];
+	int side = sideLeft(player->getLocation());
+	if (side < 0 or from->neighbors[side] == nullptr) {
+		return false;
+	}
+	Sector* to = from->neighbors[side];
+	int toIndex = to->gridY * SECTORGRID + to->gridX;
+	player->crossBorder(sideOffset(side));
+	from->state->player = nullptr;
+
+	// wait out a background batch that started before the switch and may be ticking the new foreground
+	foreground.store(toIndex);
+	while (true) {
+		int busy = claimed.load();
+		if (busy == -1 or busy == toIndex) {
+			break;
+		}
+		std::this_thread::yield();
+	}
+
+	to->state->player = player;
+	to->state->gamePause = from->state->gamePause;
+	to->state->debugMode = from->state->debugMode;
+	std::cout << "entered sector " << to->gridX << "," << to->gridY << "\n";
+	return true;
+}
@@ -0,0 +1,86 @@
+/*
+* A grid of sectors the player can fly between, each its own GameState with its own bodies, cities and entities.
+* The sector the player is in (the foreground) is ticked by the simulation thread at full rate. The others are
+* ticked together at a lower rate on a thread of their own, spread over a WorkerPool, so they keep trading
+* without costing the foreground anything.
+* An entity that crosses into a neighbouring sector is handed to it through that sector's lock-free inbox,
+* which every neighbour can push to while the owner pops from it on its own tick.
+*/
+
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Entities.h"
+#include "LockFree.h"
+#include "WorkerPool.h"
+
+struct GameState;
+class PlayerShip;
+
+static const int SECTORGRID = 3; // sectors per side, the starting sector is the middle one
+static const double SECTORBACKGROUNDRATE = 20; // default ticks per second for the sectors the player is not in
+static const double SECTORMAXDELTAT = 0.1; // longest tick a background sector takes if it falls behind
+static const int SECTORSEEDSTEP = 1000; // seed distance between neighbouring sectors
+static const int SECTORINBOXSIZE = 256; // a power of two
+static const int SECTOREXPORTCHANCE = 10; // percent of full cargo ships that trade with a neighbouring sector
+
+// An entity on its way into another sector, in the receiving sector's coordinates.
+struct EntityHandoff {
+	int kind = KindCargo;
+	Vector2D location;
+	Vector2D speed;
+	Vector2D destination;
+	int health = 10;
+	CargoHold cargo; // KindCargo, destCity is left behind as it belongs to the old sector
+	PirateBrain brain; // KindPirate
+};
+
+struct Sector {
+	GameState* state = nullptr;
+	int gridX = 0; int gridY = 0;
+	Sector* neighbors[4] = {}; // by SectorSide bit, nullptr at the edge of the grid
+	MPSCQueue<EntityHandoff, SECTORINBOXSIZE> inbox;
+};
+
+/*
+* Owns every sector but the starting one, which is the GameState handed to start().
+* Each sector's GameState is only touched by one thread at a time: the simulation thread while it is the
+* foreground and the background thread otherwise. followPlayer() moves that ownership when the player crosses.
+*/
+class SectorMap {
+private:
+	std::vector<Sector*> sectors;
+	int home = -1; // the sector start() was given
+	PlayerShip* player = nullptr;
+	std::thread background;
+	std::atomic<bool> stopRequested;
+	std::atomic<bool> paused;
+	std::atomic<int> foreground;
+	std::atomic<int> claimed; // the foreground the running background batch skips, -1 between batches
+	WorkerPool pool;
+
+	void runBackground();
+	void tickSector(Sector* sector, float deltaT);
+public:
+	double backgroundRate = SECTORBACKGROUNDRATE; // set before start()
+
+	SectorMap() : stopRequested(false), paused(false), foreground(-1), claimed(-1) {}
+	~SectorMap() { stop(); }
+	// Builds the other sectors around homeState, which must be ready to play, and starts ticking them.
+	// Their worlds are built in the background and fill in as they are ticked.
+	void start(GameState* homeState);
+	// Stops the background thread, deletes the other sectors and leaves the home GameState reset with the player.
+	void stop();
+	bool isStarted() { return !sectors.empty(); }
+	Sector* foregroundSector() { return sectors[foreground.load()]; }
+	// Only called by the simulation thread, the background sectors stop with the foreground.
+	void setPaused(bool pause) { paused.store(pause, std::memory_order_relaxed); }
+	// Hands entities that left the sector to its neighbours and takes in the ones that arrived.
+	// Called by whichever thread owns the sector, after its update.
+	void exchange(Sector* sector);
+	// Moves the player into a neighbouring sector if they crossed into one, returns true if the foreground changed.
+	// Only called by the simulation thread.
+	bool followPlayer();
+};
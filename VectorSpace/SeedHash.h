@@ -0,0 +1,17 @@
+/*
+* Mixes a seed and a few numbers into a well spread number, the same inputs always give the same result.
+* For things built from the world seed without drawing from WorldRandom, so the rest of the world comes out the same.
+*/
+
+#pragma once
+
+inline unsigned int seedHash(int seed, int a, int b, int c = 0) {
+	unsigned int h = (unsigned int)seed * 0x9E3779B1u;
+	h ^= (unsigned int)a * 0x85EBCA77u + 0x165667B1u + (h << 6) + (h >> 2);
+	h ^= (unsigned int)b * 0xC2B2AE3Du + 0x27D4EB2Fu + (h << 6) + (h >> 2);
+	h ^= (unsigned int)c * 0x9E3779B9u + 0x61C88647u + (h << 6) + (h >> 2);
+	h ^= h >> 16; h *= 0x7FEB352Du;
+	h ^= h >> 15; h *= 0x846CA68Bu;
+	h ^= h >> 16;
+	return h;
+}
@@ -0,0 +1,410 @@
+#include "Simulation.h"
+
+/*
+* For input that should not use an event, 
+* this will run with every update while in play.
+* heldKeys is a mask of HeldKey bits sent by the render thread.
+*/
+void handleInput(GameState* gameState, unsigned int heldKeys) {
+
+    // movement
+    Vector2D moveVect(0, 0);
+    double pMoveSpeed = gameState->player->getThrust();
+
+    if (heldKeys & HeldLeft) {
+        gameState->player->incrementLockLead(-gameState->deltaT * 100);
+    }
+    else if (heldKeys & HeldRight) {
+        gameState->player->incrementLockLead(gameState->deltaT * 100);
+    }
+
+    if (heldKeys & HeldW) {
+        moveVect = moveVect + Vector2D(0, -pMoveSpeed);
+    }
+    if (heldKeys & HeldS) {
+        moveVect = moveVect + Vector2D(0, pMoveSpeed);
+    }
+    if (heldKeys & HeldA) {
+        moveVect = moveVect + Vector2D(-pMoveSpeed, 0);
+    }
+    if (heldKeys & HeldD) {
+        moveVect = moveVect + Vector2D(pMoveSpeed, 0);
+    }
+
+    gameState->player->deltaSpeed(moveVect);
+
+
+    // shooting
+    if (heldKeys & HeldUp) {
+        // culled projectiles are fired again from the pool rather than created and deleted
+        Vector2D playerSpeed = gameState->player->getSpeed();
+        EntityRef lockedOn = gameState->player->getLockedOn();
+        if (gameState->entities.isAlive(lockedOn)) {
+            float playerLockOnLead = gameState->player->getLockOnLead();
+            Vector2D locSpeed = gameState->entities.location(lockedOn) + ((gameState->entities.speed(lockedOn) * gameState->deltaT) * playerLockOnLead);
+            Vector2D dir = (locSpeed - gameState->player->getLocation()).normalize();
+            gameState->projectilePool.fire(gameState, gameState->player->getLocation(), playerSpeed + dir * 1000, 16, 0.1);
+        }
+        else {
+            Vector2D playerDir = moveVect.normalize();
+            if (moveVect.magnitude() == 0) {
+                gameState->projectilePool.fire(gameState, gameState->player->getLocation(), playerSpeed + Vector2D(1000,0), 16, 0.1);
+            }
+            else {
+                gameState->projectilePool.fire(gameState, gameState->player->getLocation(), playerSpeed + playerDir * 1000, 16, 0.1);
+            }
+        }
+    }
+}
+
+// Prints the events worth seeing to the console, hits are too frequent to print.
+void logEvent(const GameEvent& event, GameState* gameState) {
+    switch (event.type)
+    {
+    case GameEvent::Kill:
+        if (event.isPlayer) {
+            std::cout << "Event: player killed\n";
+        }
+        else {
+            std::cout << "Event: entity " << event.entity.slot << ":" << event.entity.generation << " killed\n";
+        }
+        break;
+    case GameEvent::CargoDelivered:
+        std::cout << "Event: entity " << event.entity.slot << ":" << event.entity.generation << " delivered " << event.amount << " cargo to city " << event.cityID << "\n";
+        break;
+    case GameEvent::CityFull:
+        std::cout << "Event: city " << event.cityID << " is full\n";
+        break;
+    default:
+        break;
+    }
+}
+
+// Advances the game by one tick of deltaT, runs on the simulation thread for the player's sector
+// and on the SectorMap's background thread for the others.
+bool update(GameState* gameState, unsigned int heldKeys) {
+    PROFILE_ZONE("update");
+    switch (gameState->curState)
+    {
+    case StageStart:
+        break;
+    case StagePlay:
+        if (gameState->resetFlag) {
+            resetGameState(gameState);
+            return true;
+        }
+
+        // systems still being built in the background join the world between ticks
+        if (gameState->generator != nullptr) {
+            PROFILE_ZONE("update adopt");
+            adoptGeneratedWorld(gameState);
+        }
+
+        if (gameState->gamePause) {
+            // TODO: this needs to be more robust
+
+            // cleanup
+            cleaner(gameState);
+            gameState->spatialIndex.rebuild(gameState);
+            return true;
+        }
+
+        gameState->worldTime += gameState->deltaT;
+
+        if (gameState->player != nullptr) {
+            PROFILE_ZONE("update input");
+            handleInput(gameState, heldKeys);
+        }
+
+        // if the entity count is less than entity cap we should make some
+        if (gameState->entities.count() < gameState->entityCap) {
+            PROFILE_ZONE("update spawn");
+            int pick = gameState->random.next() % 4;
+            int bound = AREASIZE * 2;
+            Vector2D location = Vector2D((gameState->random.next() % bound) - AREASIZE, (gameState->random.next() % bound) - AREASIZE);
+            Vector2D destination = Vector2D((gameState->random.next() % bound) - AREASIZE, (gameState->random.next() % bound) - AREASIZE);
+            if (pick == 3) {
+                // chose to create pirate
+                gameState->entities.spawnPirate(Driveby, location, destination);
+                std::cout << "Created a new pirate\n";
+            }
+            else {
+                // chose to create neutral entity
+                gameState->entities.spawnCargo(location, destination);
+                std::cout << "Created a new entity\n";
+
+            }
+        }
+
+
+        {
+            PROFILE_ZONE("update bodies");
+            // bodies see each other where they were at the start of the tick, everything after sees them moved
+            refreshBodyLanes(gameState);
+            for (auto body : gameState->dynamicGravBodies) {
+                body->update(gameState);
+            }
+            gameState->nbody.step(gameState);
+            refreshBodyLanes(gameState);
+        }
+        {
+            PROFILE_ZONE("update projectiles");
+            for (int i = 0; i < gameState->projectiles.size(); i++) {
+                Projectile* projectile = gameState->projectiles[i];
+                int r = projectile->update(gameState);
+            }
+        }
+        {
+            PROFILE_ZONE("update entities");
+            updateEntities(gameState);
+        }
+        {
+            PROFILE_ZONE("update cities");
+            // storage is worked out when it is asked for, only the cities that just filled up are visited
+            gameState->citySchedule.run(gameState);
+            gameState->market.update(gameState);
+        }
+        if (gameState->player != nullptr) {
+            PROFILE_ZONE("update player");
+            gameState->player->update(gameState);
+        }
+        {
+            PROFILE_ZONE("update events");
+            gameState->events.dispatch(gameState);
+            unsigned int dropped = gameState->events.takeDropped();
+            if (dropped > 0) {
+                std::cout << "Event ring full, dropped " << dropped << " events\n";
+            }
+        }
+
+        // cleanup
+        cleaner(gameState);
+        {
+            PROFILE_ZONE("update spatial index");
+            gameState->spatialIndex.rebuild(gameState);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return true;
+}
+
+/* Cleans up the gamestate after each frame in play.
+*  This could be deferred 
+*/
+void cleaner(GameState* gameState) {
+    PROFILE_ZONE("cleaner");
+    // TODO: This shit needs to be looked at for memory leaks.
+    // I anticipate a lot of crashes and other issues from this code
+
+    // Cleans dead entities
+    removeDeadEntities(gameState);
+    // cleans projectiles
+    // order does not matter so the last projectile is moved into the hole rather than shifting the rest down
+    for (int iter = 0; iter < gameState->projectiles.size();) {
+        Projectile* curProjectile = gameState->projectiles[iter];
+        if (curProjectile->isCull()) {
+            gameState->projectiles[iter] = gameState->projectiles.back();
+            gameState->projectiles.pop_back();
+
+            gameState->projectilePool.release(curProjectile);
+            curProjectile = nullptr;
+        }
+        else {
+            iter++;
+        }
+    }
+    // the capacity is kept so the next projectiles fired do not allocate
+}
+
+// Starts the simulation thread on a GameState that is ready to play.
+void Simulation::start(GameState* gameState) {
+    stop();
+    state = gameState;
+    tick = 0;
+    heldKeys = 0;
+    trajectory.clear();
+    // anything left from the last session is stale
+    InputCommand command;
+    while (commands.pop(command)) {}
+    sectors.start(gameState);
+    stopRequested.store(false);
+    running.store(true);
+    worker = std::thread(&Simulation::run, this);
+}
+
+// Asks the simulation thread to finish its tick and waits for it.
+void Simulation::stop() {
+    if (!worker.joinable()) {
+        return;
+    }
+    stopRequested.store(true);
+    worker.join();
+    running.store(false);
+    sectors.stop();
+}
+
+void Simulation::applyCommand(InputCommand& command) {
+    // while paused actions are ignored like the old event handling, but held keys and the brake are still recorded
+    // since the renderer only sends them when they change, update does not tick on them until unpaused
+    if (state->gamePause and command.type == InputCommand::LockOn) {
+        return;
+    }
+    switch (command.type)
+    {
+    case InputCommand::HeldKeys:
+        heldKeys = command.keys;
+        if (heldKeys & HeldQ) {
+            state->player->setThrustDir(-1);
+        }
+        else if (heldKeys & HeldE) {
+            state->player->setThrustDir(1);
+        }
+        else {
+            state->player->setThrustDir(0);
+        }
+        break;
+    case InputCommand::BrakeOn:
+        state->player->doBrake();
+        break;
+    case InputCommand::BrakeOff:
+        state->player->unbrake();
+        break;
+    case InputCommand::LockOn:
+        state->player->lockonClosest(state, 400);
+        break;
+    case InputCommand::TogglePause:
+        state->gamePause = !state->gamePause;
+        std::cout << (state->gamePause ? "pause\n" : "unpause\n");
+        break;
+    case InputCommand::ViewSize:
+        viewOffsetX = command.offsetX; viewOffsetY = command.offsetY;
+        viewWidth = command.width; viewHeight = command.height;
+        break;
+    default:
+        break;
+    }
+}
+
+// The simulation thread, ticks at up to SIMTICKRATE until stopped or the game resets.
+void Simulation::run() {
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 tickLength = (Uint64)(frequency / SIMTICKRATE);
+    Uint64 last = SDL_GetPerformanceCounter();
+
+    while (!stopRequested.load(std::memory_order_relaxed)) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now - last < tickLength) {
+            SDL_DelayNS((Uint64)((tickLength - (now - last)) * 1000000000.0 / frequency));
+            continue;
+        }
+        state->deltaT = ((now - last) / (float)frequency);
+        last = now;
+
+        InputCommand command;
+        while (commands.pop(command)) {
+            applyCommand(command);
+        }
+        sectors.setPaused(state->gamePause);
+
+        update(state, heldKeys);
+        if (state->curState != StagePlay) { // the game was reset
+            break;
+        }
+        sectors.exchange(sectors.foregroundSector());
+        if (sectors.followPlayer()) {
+            state = sectors.foregroundSector()->state;
+        }
+        trajectory.update(state);
+
+        buildSnapshot(snapshots.writeBuffer());
+        snapshots.publish();
+        tick++;
+    }
+    running.store(false, std::memory_order_release);
+}
+
+// Copies what is inside the view into a snapshot, the vectors keep their size between uses.
+void Simulation::buildSnapshot(RenderSnapshot& snapshot) {
+    PlayerShip* player = state->player;
+    snapshot.tick = tick;
+    snapshot.deltaT = state->deltaT;
+    snapshot.paused = state->gamePause;
+    snapshot.seed = state->seed;
+    snapshot.sectorX = sectors.foregroundSector()->gridX;
+    snapshot.sectorY = sectors.foregroundSector()->gridY;
+    snapshot.playerLocation = player->getLocation();
+    snapshot.playerSpeed = player->getSpeed();
+    snapshot.gravDelta = player->getGravDelta();
+    snapshot.playerDelta = player->getPlayerDelta();
+    snapshot.thrust = player->getThrust();
+    snapshot.health = player->getHealth();
+    snapshot.lockOnLead = player->getLockOnLead();
+    snapshot.parked = player->isParked();
+    snapshot.moving = player->isMoving();
+    snapshot.entityCount = state->entities.count();
+    snapshot.entitiesAsleep = state->entities.asleepCount();
+    snapshot.cityCount = (int)state->cities.size();
+
+    EntityRef lockedOn = player->getLockedOn();
+    snapshot.hasLockOn = state->entities.isAlive(lockedOn);
+    if (snapshot.hasLockOn) {
+        snapshot.lockOnLocation = state->entities.location(lockedOn);
+        snapshot.lockOnLeadLocation = state->entities.location(lockedOn) + ((state->entities.speed(lockedOn) * state->deltaT) * player->getLockOnLead());
+    }
+
+    double minX = snapshot.playerLocation.x - viewOffsetX;
+    double minY = snapshot.playerLocation.y - viewOffsetY;
+    WorldRect view(minX, minY, minX + viewWidth, minY + viewHeight);
+    visibleStatic.clear(); visibleDynamic.clear(); visibleCities.clear();
+    visibleEntities.clear(); visibleProjectiles.clear();
+    state->spatialIndex.queryStaticBodies(view, visibleStatic);
+    state->spatialIndex.queryDynamicBodies(view, visibleDynamic);
+    state->spatialIndex.queryCities(view, visibleCities);
+    state->spatialIndex.queryEntities(view, visibleEntities);
+    state->spatialIndex.queryProjectiles(view, visibleProjectiles);
+
+    snapshot.staticBodies.resize(visibleStatic.size());
+    for (int i = 0; i < (int)visibleStatic.size(); i++) {
+        snapshot.staticBodies[i].location = visibleStatic[i]->location;
+        snapshot.staticBodies[i].radius = visibleStatic[i]->radius;
+    }
+    snapshot.dynamicBodies.resize(visibleDynamic.size());
+    for (int i = 0; i < (int)visibleDynamic.size(); i++) {
+        snapshot.dynamicBodies[i].location = visibleDynamic[i]->location;
+        snapshot.dynamicBodies[i].radius = visibleDynamic[i]->radius;
+    }
+    snapshot.cities.resize(visibleCities.size());
+    for (int i = 0; i < (int)visibleCities.size(); i++) {
+        City* city = visibleCities[i];
+        SnapshotCity& out = snapshot.cities[i];
+        out.location = city->getTiedBody()->location;
+        out.radius = city->getTiedBody()->radius;
+        out.id = city->getID();
+        out.pcPS = city->getpcPS();
+        out.storage = city->getCurStorage(state->worldTime);
+        out.storageLimit = city->getStorageLimit();
+    }
+    snapshot.entities.resize(visibleEntities.size());
+    for (int i = 0; i < (int)visibleEntities.size(); i++) {
+        EntityRef ref = visibleEntities[i];
+        Navigation& nav = state->entities.navigation(ref);
+        SnapshotEntity& out = snapshot.entities[i];
+        out.location = state->entities.location(ref);
+        out.destination = nav.destination;
+        out.currentDest = nav.currentDest;
+        out.faction = state->entities.faction(ref);
+        out.hasClosestBody = nav.closestBody != nullptr;
+        if (out.hasClosestBody) {
+            out.closestBodyLocation = nav.closestBody->location;
+        }
+    }
+    snapshot.projectiles.resize(visibleProjectiles.size());
+    for (int i = 0; i < (int)visibleProjectiles.size(); i++) {
+        snapshot.projectiles[i] = visibleProjectiles[i]->getLocation();
+    }
+    trajectory.getPath(snapshot.trajectory);
+    snapshot.trajectoryBlocked = trajectory.endsBlocked();
+}
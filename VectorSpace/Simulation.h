@@ -0,0 +1,144 @@
+/*
+* Runs the game update on its own thread.
+* Input reaches it through a command queue and it hands finished frames to the renderer as snapshots.
+*/
+
+#pragma once
+#include <SDL3/SDL.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "GameData.h"
+#include "LockFree.h"
+#include "Sectors.h"
+#include "Trajectory.h"
+#include "WorldGen.h"
+
+static const double SIMTICKRATE = 144; // max simulation ticks per second
+
+// Bits for the keys that are read every tick rather than through events.
+enum HeldKey {
+	HeldW = 1 << 0, HeldA = 1 << 1, HeldS = 1 << 2, HeldD = 1 << 3,
+	HeldQ = 1 << 4, HeldE = 1 << 5,
+	HeldUp = 1 << 6, HeldLeft = 1 << 7, HeldRight = 1 << 8
+};
+
+// Something the render/event thread wants the simulation to do.
+struct InputCommand {
+	enum Type { HeldKeys, BrakeOn, BrakeOff, LockOn, TogglePause, ViewSize };
+	Type type = HeldKeys;
+	unsigned int keys = 0; // HeldKeys
+	double offsetX = 0; double offsetY = 0; // ViewSize, where the player is drawn
+	double width = 0; double height = 0; // ViewSize, the size of the view in world units
+};
+
+// Copies of just what the renderer draws.
+struct SnapshotBody {
+	Vector2D location;
+	double radius;
+};
+struct SnapshotCity {
+	Vector2D location;
+	double radius;
+	int id;
+	float pcPS;
+	float storage;
+	float storageLimit;
+};
+struct SnapshotEntity {
+	Vector2D location;
+	Vector2D destination;
+	Vector2D currentDest;
+	char faction;
+	bool hasClosestBody;
+	Vector2D closestBodyLocation;
+};
+
+// Everything renderGame needs for one frame, filled by the simulation thread and read only by the renderer.
+struct RenderSnapshot {
+	Uint64 tick = 0;
+	float deltaT = 0;
+	bool paused = false;
+	int seed = 0;
+	int sectorX = 0; int sectorY = 0;
+
+	Vector2D playerLocation;
+	Vector2D playerSpeed;
+	Vector2D gravDelta;
+	Vector2D playerDelta;
+	double thrust = 0;
+	int health = 0;
+	float lockOnLead = 0;
+	bool parked = false;
+	bool moving = false;
+	bool hasLockOn = false;
+	Vector2D lockOnLocation;
+	Vector2D lockOnLeadLocation;
+	int entityCount = 0;
+	int entitiesAsleep = 0;
+	int cityCount = 0;
+
+	// only what is inside the view rectangle
+	std::vector<SnapshotBody> staticBodies;
+	std::vector<SnapshotBody> dynamicBodies;
+	std::vector<SnapshotCity> cities;
+	std::vector<SnapshotEntity> entities;
+	std::vector<Vector2D> projectiles;
+	std::vector<Vector2D> trajectory; // where the player is heading, see Trajectory.h
+	bool trajectoryBlocked = false;
+};
+
+// See Simulation.cpp for descriptions.
+bool update(GameState* gameState, unsigned int heldKeys);
+void cleaner(GameState* gameState);
+void handleInput(GameState* gameState, unsigned int heldKeys);
+void logEvent(const GameEvent& event, GameState* gameState);
+
+/*
+* Owns the simulation thread for one play session.
+* start() hands the GameState to the thread, it must not be touched by anyone else until the thread has
+* finished, either by stop() or by the game resetting back to the menu.
+* The GameState is the middle of a SectorMap, the thread ticks whichever sector the player is in.
+*/
+class Simulation {
+private:
+	std::thread worker;
+	std::atomic<bool> stopRequested;
+	std::atomic<bool> running;
+	GameState* state = nullptr; // the sector the player is in
+	SectorMap sectors;
+	TrajectoryPredictor trajectory;
+	SPSCQueue<InputCommand, 256> commands;
+	TripleBuffer<RenderSnapshot> snapshots;
+
+	// only used by the simulation thread
+	unsigned int heldKeys = 0;
+	double viewOffsetX = 0; double viewOffsetY = 0;
+	double viewWidth = 0; double viewHeight = 0;
+	Uint64 tick = 0;
+	std::vector<StaticGravBody*> visibleStatic;
+	std::vector<DynamicGravBody*> visibleDynamic;
+	std::vector<City*> visibleCities;
+	std::vector<EntityRef> visibleEntities;
+	std::vector<Projectile*> visibleProjectiles;
+
+	void run();
+	void applyCommand(InputCommand& command);
+	void buildSnapshot(RenderSnapshot& snapshot);
+public:
+	Simulation() : stopRequested(false), running(false) {}
+	~Simulation() { stop(); }
+	void start(GameState* gameState);
+	void stop();
+	// true once the thread has been started and not yet joined
+	bool isActive() { return worker.joinable(); }
+	// true if the thread exited on its own (the game reset), call stop() to join it
+	bool hasFinished() { return worker.joinable() and !running.load(std::memory_order_acquire); }
+	bool pushCommand(const InputCommand& command) { return commands.push(command); }
+	// Swaps in the newest snapshot if there is one, the returned snapshot stays valid until the next call.
+	RenderSnapshot& latestSnapshot() {
+		snapshots.acquire();
+		return snapshots.readBuffer();
+	}
+};
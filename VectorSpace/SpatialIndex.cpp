@@ -0,0 +1,61 @@
+#include "SpatialIndex.h"
+#include "GameData.h"
+
+static const double MINCELLSIZE = 500;
+static const int MAXCELLS = 256; // per axis
+
+// Sizes the grid to the static bodies in the world and buckets them.
+void SpatialIndex::rebuildStatic(GameState* state) {
+	double minX = -AREASIZE; double minY = -AREASIZE;
+	double maxX = AREASIZE; double maxY = AREASIZE;
+	for (auto body : state->staticGravBodies) {
+		minX = fmin(minX, body->location.x - body->radius); maxX = fmax(maxX, body->location.x + body->radius);
+		minY = fmin(minY, body->location.y - body->radius); maxY = fmax(maxY, body->location.y + body->radius);
+	}
+	double extent = fmax(maxX - minX, maxY - minY);
+	grid.cellSize = fmax(MINCELLSIZE, extent / MAXCELLS);
+	grid.originX = minX; grid.originY = minY;
+	grid.cellsX = (int)ceil((maxX - minX) / grid.cellSize) + 1;
+	grid.cellsY = (int)ceil((maxY - minY) / grid.cellSize) + 1;
+
+	staticBodies.build(state->staticGravBodies, grid, [](StaticGravBody* body, double& x, double& y, double& r) {
+		x = body->location.x; y = body->location.y; r = body->radius;
+	});
+	staticStale = false;
+}
+
+// Re-buckets every object that moves, after rebuilding the grid and static bodies if bodies were added since.
+void SpatialIndex::rebuild(GameState* state) {
+	if (staticStale) {
+		rebuildStatic(state);
+	}
+	dynamicBodies.build(state->dynamicGravBodies, grid, [](DynamicGravBody* body, double& x, double& y, double& r) {
+		x = body->location.x; y = body->location.y; r = body->radius;
+	});
+	cities.build(state->cities, grid, [](City* city, double& x, double& y, double& r) {
+		x = city->getTiedBody()->location.x; y = city->getTiedBody()->location.y; r = city->getTiedBody()->radius + 40; // + the drawn buildings
+	});
+	entityRefs.clear();
+	for (int k = 0; k < KINDCOUNT; k++) {
+		for (int i = 0; i < state->entities.archetypes[k].size(); i++) {
+			entityRefs.push_back(state->entities.refAt(k, i));
+		}
+	}
+	entities.build(entityRefs, grid, [state](EntityRef ref, double& x, double& y, double& r) {
+		Vector2D& location = state->entities.location(ref);
+		x = location.x; y = location.y; r = 12;
+	});
+	projectiles.build(state->projectiles, grid, [](Projectile* projectile, double& x, double& y, double& r) {
+		x = projectile->getLocation().x; y = projectile->getLocation().y; r = 5;
+	});
+}
+
+void SpatialIndex::clear() {
+	staticBodies.clear();
+	dynamicBodies.clear();
+	cities.clear();
+	entities.clear();
+	projectiles.clear();
+	entityRefs.clear();
+	staticStale = true;
+}
@@ -0,0 +1,148 @@
+/*
+* A uniform grid over the world used to find the objects inside a rectangle without visiting all of them.
+*/
+
+#pragma once
+#include <vector>
+#include <math.h>
+
+#include "Entities.h"
+
+struct GameState;
+class Body;
+class StaticGravBody;
+class DynamicGravBody;
+class City;
+class Projectile;
+
+// An axis aligned rectangle in world space.
+struct WorldRect {
+	double minX = 0; double minY = 0;
+	double maxX = 0; double maxY = 0;
+	WorldRect() {}
+	WorldRect(double x1, double y1, double x2, double y2) {
+		minX = x1; minY = y1; maxX = x2; maxY = y2;
+	}
+};
+
+// The shape of the grid, cells outside the bounds are clamped to the border cells
+// so objects that leave the play area can still be found.
+struct GridLayout {
+	double originX = 0; double originY = 0;
+	double cellSize = 1;
+	int cellsX = 1; int cellsY = 1;
+	int cellX(double x) {
+		int c = (int)floor((x - originX) / cellSize);
+		return c < 0 ? 0 : (c >= cellsX ? cellsX - 1 : c);
+	}
+	int cellY(double y) {
+		int c = (int)floor((y - originY) / cellSize);
+		return c < 0 ? 0 : (c >= cellsY ? cellsY - 1 : c);
+	}
+	int cellCount() { return cellsX * cellsY; }
+};
+
+/*
+* One kind of object bucketed by the cell its center is in.
+* Items are counting sorted so each cell is a contiguous range, a rebuild does not allocate once the vectors have grown.
+* Positions and radii are kept next to the items so a query only touches the objects it returns.
+* Item is a pointer for objects that live on the heap and an EntityRef for entities.
+*/
+template <typename Item>
+class GridBucket {
+private:
+	std::vector<int> cellStart; // cellCount + 1 offsets into items
+	std::vector<int> cellOf;
+	std::vector<Item> items;
+	std::vector<double> itemX;
+	std::vector<double> itemY;
+	std::vector<double> itemR;
+	double maxRadius = 0;
+public:
+	// pos(Item, double& x, double& y, double& r) fills in where an item is.
+	template <typename PosFn>
+	void build(const std::vector<Item>& source, GridLayout& grid, PosFn pos) {
+		int count = (int)source.size();
+		cellStart.assign(grid.cellCount() + 1, 0);
+		cellOf.resize(count);
+		items.resize(count);
+		itemX.resize(count); itemY.resize(count); itemR.resize(count);
+		maxRadius = 0;
+
+		for (int i = 0; i < count; i++) {
+			double x; double y; double r;
+			pos(source[i], x, y, r);
+			int cell = grid.cellY(y) * grid.cellsX + grid.cellX(x);
+			cellOf[i] = cell;
+			cellStart[cell + 1]++;
+			if (r > maxRadius) {
+				maxRadius = r;
+			}
+		}
+		for (int c = 0; c < grid.cellCount(); c++) {
+			cellStart[c + 1] += cellStart[c];
+		}
+		// cellStart is used as the write cursor for each cell while placing
+		for (int i = 0; i < count; i++) {
+			int slot = cellStart[cellOf[i]];
+			cellStart[cellOf[i]]++;
+			double x; double y; double r;
+			pos(source[i], x, y, r);
+			items[slot] = source[i];
+			itemX[slot] = x; itemY[slot] = y; itemR[slot] = r;
+		}
+		// placing shifted every start forward by one cell, shift them back
+		for (int c = grid.cellCount(); c > 0; c--) {
+			cellStart[c] = cellStart[c - 1];
+		}
+		cellStart[0] = 0;
+	}
+
+	// Appends every item whose circle overlaps the rectangle to out.
+	void query(GridLayout& grid, WorldRect rect, std::vector<Item>& out) {
+		if (items.empty()) {
+			return;
+		}
+		int x1 = grid.cellX(rect.minX - maxRadius); int x2 = grid.cellX(rect.maxX + maxRadius);
+		int y1 = grid.cellY(rect.minY - maxRadius); int y2 = grid.cellY(rect.maxY + maxRadius);
+		for (int cy = y1; cy <= y2; cy++) {
+			int rowStart = cy * grid.cellsX;
+			// cells in a row are contiguous so the whole row span is one range
+			for (int i = cellStart[rowStart + x1]; i < cellStart[rowStart + x2 + 1]; i++) {
+				double r = itemR[i];
+				if (itemX[i] + r >= rect.minX and itemX[i] - r <= rect.maxX
+					and itemY[i] + r >= rect.minY and itemY[i] - r <= rect.maxY) {
+					out.push_back(items[i]);
+				}
+			}
+		}
+	}
+	int size() { return (int)items.size(); }
+	// Empties the bucket, queries return nothing until the next build.
+	void clear() { items.clear(); itemX.clear(); itemY.clear(); itemR.clear(); cellOf.clear(); }
+};
+
+// Grid buckets for everything that gets drawn, rebuilt once per tick after objects have moved.
+// Static bodies never move, so the grid and their bucket are only rebuilt after bodies are added.
+class SpatialIndex {
+private:
+	GridLayout grid;
+	GridBucket<StaticGravBody*> staticBodies;
+	bool staticStale = true; // the grid and staticBodies are rebuilt on the next rebuild
+	GridBucket<DynamicGravBody*> dynamicBodies;
+	GridBucket<City*> cities;
+	GridBucket<EntityRef> entities;
+	GridBucket<Projectile*> projectiles;
+	std::vector<EntityRef> entityRefs; // every live entity, refilled by rebuild
+	void rebuildStatic(GameState* state);
+public:
+	void rebuild(GameState* state);
+	void clear();
+	// Bodies were added or removed, called by refreshBodyLanes when the body count changes.
+	void bodiesChanged() { staticStale = true; }
+	void queryStaticBodies(WorldRect rect, std::vector<StaticGravBody*>& out) { staticBodies.query(grid, rect, out); }
+	void queryDynamicBodies(WorldRect rect, std::vector<DynamicGravBody*>& out) { dynamicBodies.query(grid, rect, out); }
+	void queryCities(WorldRect rect, std::vector<City*>& out) { cities.query(grid, rect, out); }
+	void queryEntities(WorldRect rect, std::vector<EntityRef>& out) { entities.query(grid, rect, out); }
+	void queryProjectiles(WorldRect rect, std::vector<Projectile*>& out) { projectiles.query(grid, rect, out); }
+};
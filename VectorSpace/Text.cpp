@@ -0,0 +1,146 @@
+#include "Text.h"
+
+void TextCache::setFont(SDL_Texture* texture) {
+	fontTexture = texture;
+	if (fontTexture != nullptr) {
+		SDL_GetTextureSize(fontTexture, &fontTextureW, &fontTextureH);
+	}
+	clear();
+}
+
+// Lays a string out into quads starting at (0, 0), matching the old per character renderText.
+void TextCache::layout(GlyphRun& run, const std::string& text, int kerning, int fontSize) {
+	run.vertices.clear();
+	float penX = 0; float penY = 0;
+	SDL_FColor white = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+	for (char c : text) {
+		int choice = c - 32;
+		if (c == '\n') {
+			penY += fontSize;
+			penX = 0;
+		}
+		if (choice < 0 || choice > 127 - 32) {
+			continue;
+		}
+		float u0 = (choice % GLYPHCOLUMNS) * GLYPHSIZE / fontTextureW;
+		float v0 = (choice / GLYPHCOLUMNS) * GLYPHSIZE / fontTextureH;
+		float u1 = u0 + GLYPHSIZE / fontTextureW;
+		float v1 = v0 + GLYPHSIZE / fontTextureH;
+
+		SDL_Vertex quad[4];
+		quad[0].position = { penX, penY };						quad[0].tex_coord = { u0, v0 };
+		quad[1].position = { penX + fontSize, penY };			quad[1].tex_coord = { u1, v0 };
+		quad[2].position = { penX + fontSize, penY + fontSize };	quad[2].tex_coord = { u1, v1 };
+		quad[3].position = { penX, penY + fontSize };			quad[3].tex_coord = { u0, v1 };
+		for (SDL_Vertex& vert : quad) {
+			vert.color = white;
+			run.vertices.push_back(vert);
+		}
+		penX += kerning;
+	}
+}
+
+// Adds a string to this frame's batch, laying it out only if it is not already cached.
+void TextCache::queue(const std::string& text, float x, float y, int kerning, int fontSize) {
+	std::unordered_map<std::string, GlyphRun>& sized = runs[(fontSize << 16) | (kerning & 0xFFFF)];
+	auto found = sized.find(text);
+	if (found == sized.end()) {
+		found = sized.emplace(text, GlyphRun()).first;
+		layout(found->second, text, kerning, fontSize);
+		runCount++;
+	}
+	GlyphRun& run = found->second;
+	run.lastUsedFrame = frame;
+
+	for (const SDL_Vertex& vert : run.vertices) {
+		SDL_Vertex placed = vert;
+		placed.position.x += x;
+		placed.position.y += y;
+		frameVertices.push_back(placed);
+	}
+}
+
+// Draws every queued glyph in one call and starts a new frame.
+void TextCache::flush(SDL_Renderer* renderer) {
+	int glyphCount = (int)frameVertices.size() / 4;
+
+	// All quads share the same index pattern so it only needs to grow.
+	for (int i = (int)frameIndices.size() / 6; i < glyphCount; i++) {
+		int base = i * 4;
+		frameIndices.push_back(base);
+		frameIndices.push_back(base + 1);
+		frameIndices.push_back(base + 2);
+		frameIndices.push_back(base);
+		frameIndices.push_back(base + 2);
+		frameIndices.push_back(base + 3);
+	}
+
+	if (glyphCount > 0 and fontTexture != nullptr) {
+		SDL_RenderGeometry(renderer, fontTexture, frameVertices.data(), (int)frameVertices.size(), frameIndices.data(), glyphCount * 6);
+	}
+	frameVertices.clear();
+
+	frame++;
+	if (frame % EVICTAFTER == 0) {
+		evictStale();
+	}
+}
+
+// Drops runs that have not been drawn recently, strings like positions change every frame.
+void TextCache::evictStale() {
+	for (auto& sized : runs) {
+		for (auto iter = sized.second.begin(); iter != sized.second.end();) {
+			if (frame - iter->second.lastUsedFrame > EVICTAFTER) {
+				iter = sized.second.erase(iter);
+				runCount--;
+			}
+			else {
+				iter++;
+			}
+		}
+	}
+}
+
+void TextCache::clear() {
+	runs.clear();
+	frameVertices.clear();
+	runCount = 0;
+}
+
+bool TextLabel::unchanged(const char* prefix, int kind, double a, double b) {
+	if (lastKind == kind and lastPrefix == prefix and lastA == a and lastB == b) {
+		return true;
+	}
+	lastKind = kind; lastPrefix = prefix; lastA = a; lastB = b;
+	text = prefix;
+	return false;
+}
+
+const std::string& TextLabel::number(const char* prefix, double value) {
+	if (!unchanged(prefix, 0, value, 0)) {
+		text += std::to_string(value);
+	}
+	return text;
+}
+
+const std::string& TextLabel::integer(const char* prefix, long long value) {
+	if (!unchanged(prefix, 1, (double)value, 0)) {
+		text += std::to_string(value);
+	}
+	return text;
+}
+
+const std::string& TextLabel::pair(const char* prefix, double x, double y) {
+	if (!unchanged(prefix, 2, x, y)) {
+		text += "[" + std::to_string(x) + " " + std::to_string(y) + "]";
+	}
+	return text;
+}
+
+const std::string& TextLabel::ratio(double a, double b) {
+	if (!unchanged("", 3, a, b)) {
+		text += std::to_string(a) + "|" + std::to_string(b);
+	}
+	return text;
+}
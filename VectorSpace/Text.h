@@ -0,0 +1,62 @@
+/*
+* Cached text layout and batched glyph drawing for the bitmap font.
+*/
+
+#pragma once
+#include <SDL3/SDL.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// A string laid out once into glyph quads relative to its origin.
+struct GlyphRun {
+	std::vector<SDL_Vertex> vertices; // 4 per glyph
+	Uint64 lastUsedFrame = 0;
+};
+
+/*
+* Caches the glyph quads of every string drawn, keyed by (kerning, font size) and then the string,
+* so only strings whose content changed get laid out again.
+* Each frame's glyphs are collected and submitted with one SDL_RenderGeometry call in flush().
+*/
+class TextCache {
+private:
+	SDL_Texture* fontTexture = nullptr;
+	float fontTextureW = 1; float fontTextureH = 1;
+	std::unordered_map<int, std::unordered_map<std::string, GlyphRun>> runs;
+	std::vector<SDL_Vertex> frameVertices;
+	std::vector<int> frameIndices;
+	Uint64 frame = 0;
+	int runCount = 0;
+
+	void layout(GlyphRun& run, const std::string& text, int kerning, int fontSize);
+	void evictStale();
+public:
+	static const int GLYPHSIZE = 32; // size of a glyph in the font texture
+	static const int GLYPHCOLUMNS = 11; // glyphs per row in the font texture
+	static const Uint64 EVICTAFTER = 120; // frames a run can go unused before it is dropped
+
+	void setFont(SDL_Texture* texture);
+	void queue(const std::string& text, float x, float y, int kerning, int fontSize);
+	void flush(SDL_Renderer* renderer);
+	void clear();
+	int cachedRuns() { return runCount; }
+};
+
+/*
+* Holds a formatted label and only rebuilds the string when the value shown changes.
+* Formatting matches std::to_string and Vector2D::toString.
+*/
+class TextLabel {
+private:
+	std::string text;
+	const char* lastPrefix = nullptr;
+	double lastA = 0; double lastB = 0;
+	int lastKind = -1;
+	bool unchanged(const char* prefix, int kind, double a, double b);
+public:
+	const std::string& number(const char* prefix, double value);
+	const std::string& integer(const char* prefix, long long value);
+	const std::string& pair(const char* prefix, double x, double y);
+	const std::string& ratio(double a, double b); // "a|b"
+};
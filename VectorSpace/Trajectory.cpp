@@ -0,0 +1,260 @@
+#include "Trajectory.h"
+#include "GameData.h"
+
+#include <math.h>
+
+// Takes down how every body is moving right now, the path assumes they carry on that way.
+void TrajectoryPredictor::capturePlans(GameState* state) {
+	int staticCount = (int)state->staticGravBodies.size();
+	int total = staticCount + (int)state->dynamicGravBodies.size();
+	plans.kind.resize(total); plans.location.resize(total); plans.speed.resize(total); plans.accel.resize(total);
+	plans.mass.resize(total); plans.radius.resize(total); plans.dynamic.resize(total); plans.orbitIndex.resize(total);
+	plans.orbitTime.resize(total); plans.orbitRate.resize(total); plans.orbitStart.resize(total); plans.orbitEnd.resize(total);
+	plans.orbitX.resize(total); plans.orbitY.resize(total); plans.bodies.resize(total);
+	futureFrom.resize(total); futureTo.resize(total); future.resize(total);
+	plans.captured = clock;
+	futureToTime = -1;
+
+	for (int i = 0; i < total; i++) {
+		bool dynamic = i >= staticCount;
+		Body* body = dynamic ? (Body*)state->dynamicGravBodies[i - staticCount] : (Body*)state->staticGravBodies[i];
+		plans.bodies[i] = body;
+		plans.location[i] = body->location;
+		plans.speed[i] = body->speed;
+		plans.accel[i] = Vector2D(0, 0);
+		plans.mass[i] = body->mass;
+		plans.radius[i] = body->radius;
+		plans.dynamic[i] = dynamic;
+		plans.kind[i] = PlanStatic;
+		if (!dynamic) {
+			continue;
+		}
+
+		DynamicGravBody* moving = state->dynamicGravBodies[i - staticCount];
+		plans.kind[i] = PlanCarried;
+		plans.accel[i] = moving->lastAccel;
+		if (moving->moveType == 1 and moving->orbitBody != nullptr) {
+			// bodyID is the index in whichever list the body is in, statics come first in the plans
+			Body* orbited = moving->orbitBody;
+			int index = orbited->bodyID;
+			if (index >= 0 and index < staticCount and state->staticGravBodies[index] == orbited) {
+				plans.orbitIndex[i] = index;
+			}
+			else if (index >= 0 and index < total - staticCount and state->dynamicGravBodies[index] == orbited) {
+				plans.orbitIndex[i] = staticCount + index;
+			}
+			else {
+				continue;
+			}
+			plans.kind[i] = PlanOrbit;
+			plans.orbitTime[i] = moving->timeCur;
+			plans.orbitRate[i] = moving->deltaMul;
+			plans.orbitStart[i] = moving->timetart;
+			plans.orbitEnd[i] = moving->timeEnd;
+			plans.orbitX[i] = moving->XMul;
+			plans.orbitY[i] = moving->YMul;
+		}
+	}
+}
+
+// true when a body has strayed from its plan, orbits follow theirs exactly so only the rest are checked.
+bool TrajectoryPredictor::plansStale(GameState* state) {
+	double elapsed = clock - plans.captured;
+	for (int i = 0; i < (int)plans.bodies.size(); i++) {
+		if (plans.kind[i] != PlanCarried) {
+			continue;
+		}
+		Vector2D expected = plans.location[i] + plans.speed[i] * elapsed + plans.accel[i] * (0.5 * elapsed * elapsed);
+		if ((plans.bodies[i]->location - expected).magnitude() > TRAJECTORYBODYSLACK) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Fills out with where every body will be at time, an orbit follows the body it orbits when that comes first.
+void TrajectoryPredictor::bodiesAt(double time, std::vector<Vector2D>& out) {
+	double elapsed = time - plans.captured;
+	for (int i = 0; i < (int)plans.bodies.size(); i++) {
+		switch (plans.kind[i])
+		{
+		case PlanOrbit:
+		{
+			// the same as DynamicGravBody::update, timeCur goes back to the start once it passes the end
+			double orbitTime = plans.orbitTime[i] + elapsed * plans.orbitRate[i];
+			if (orbitTime > plans.orbitEnd[i]) {
+				orbitTime = plans.orbitStart[i] + fmod(orbitTime - plans.orbitEnd[i], plans.orbitEnd[i] - plans.orbitStart[i]);
+			}
+			int orbited = plans.orbitIndex[i];
+			Vector2D center = orbited < i ? out[orbited] : plans.location[orbited] + plans.speed[orbited] * elapsed;
+			out[i] = Vector2D(cos(orbitTime) * plans.orbitX[i], sin(orbitTime) * plans.orbitY[i]) + center;
+		}
+		break;
+		case PlanCarried:
+			out[i] = plans.location[i] + plans.speed[i] * elapsed + plans.accel[i] * (0.5 * elapsed * elapsed);
+			break;
+		default:
+			out[i] = plans.location[i];
+			break;
+		}
+	}
+}
+
+// doGravity over the bodies in future.
+Vector2D TrajectoryPredictor::gravityAt(Vector2D location) {
+	Vector2D deltaVec = Vector2D(0, 0);
+	for (int i = 0; i < (int)plans.bodies.size(); i++) {
+		Vector2D locVec = future[i] - location;
+		simScalar distance = locVec.magnitude();
+		simScalar grav = calcGravity(plans.mass[i], distance);
+		if (!plans.dynamic[i]) {
+			deltaVec = deltaVec + locVec.normalize() * grav;
+			continue;
+		}
+		if (distance == 0 or locVec.y == 0) {
+			continue;
+		}
+		Vector2D direction = Vector2D(locVec.x == 0 ? 0 : (locVec.x < 0 ? -1 : 1), locVec.y < 0 ? -1 : 1);
+		deltaVec = deltaVec + direction * grav;
+	}
+	return deltaVec;
+}
+
+Body* TrajectoryPredictor::insideBody(Vector2D location) {
+	for (int i = 0; i < (int)plans.bodies.size(); i++) {
+		if ((future[i] - location).magnitudeSquared() < plans.radius[i] * plans.radius[i]) {
+			return plans.bodies[i];
+		}
+	}
+	return nullptr;
+}
+
+// Integrates one point on from the last the way PlayerShip::update moves the ship.
+// The bodies are only worked out at the two points and moved in a straight line in between, over a step they barely turn.
+// Returns false when the ship would hit a body on the way.
+bool TrajectoryPredictor::step(GameState* state, const TrajectoryPoint& from, TrajectoryPoint& to) {
+	const double substep = TRAJECTORYSTEP / TRAJECTORYSUBSTEPS;
+	if (futureToTime == from.time) {
+		futureFrom.swap(futureTo);
+	}
+	else {
+		bodiesAt(from.time, futureFrom);
+	}
+	bodiesAt(from.time + TRAJECTORYSTEP, futureTo);
+	to = from;
+	for (int s = 0; s < TRAJECTORYSUBSTEPS; s++) {
+		// the bodies move before the player in a tick
+		to.time += substep;
+		simScalar along = simScalar(s + 1) / TRAJECTORYSUBSTEPS;
+		for (int i = 0; i < (int)future.size(); i++) {
+			future[i] = futureFrom[i] + (futureTo[i] - futureFrom[i]) * along;
+		}
+		Vector2D newSpeed = to.speed + (lastThrust * substep) + (gravityAt(to.location) * substep);
+		newSpeed.x = fmax(-10000, fmin(10000, newSpeed.x));
+		newSpeed.y = fmax(-10000, fmin(10000, newSpeed.y));
+		if (insideBody(to.location + newSpeed * substep) != nullptr) {
+			futureToTime = -1;
+			return false;
+		}
+		to.speed = newSpeed;
+		to.location = to.location + (newSpeed * substep);
+
+		// stopped at the edge of the area like the player is
+		if ((to.location.x < -AREASIZE and !(state->openBorders & SideLeft)) or (to.location.x > AREASIZE and !(state->openBorders & SideRight))) {
+			to.location.x = fmax(-AREASIZE, fmin(AREASIZE, to.location.x));
+			to.speed.x = 0;
+		}
+		if ((to.location.y < -AREASIZE and !(state->openBorders & SideTop)) or (to.location.y > AREASIZE and !(state->openBorders & SideBottom))) {
+			to.location.y = fmax(-AREASIZE, fmin(AREASIZE, to.location.y));
+			to.speed.y = 0;
+		}
+	}
+	futureToTime = to.time;
+	return true;
+}
+
+// Throws the path away and starts it again from where the player is.
+void TrajectoryPredictor::restart(GameState* state) {
+	PlayerShip* player = state->player;
+	capturePlans(state);
+	lastState = state;
+	lastThrust = player->getPlayerDelta();
+	first = 0;
+	count = 1;
+	blocked = false;
+	points[0].location = player->getLocation();
+	points[0].speed = player->getSpeed();
+	points[0].time = clock;
+	restarts++;
+}
+
+// Drops the points after a time, keeping at least the first.
+void TrajectoryPredictor::truncate(double after) {
+	while (count > 1 and at(count - 1).time > after) {
+		count--;
+	}
+	blocked = false;
+}
+
+void TrajectoryPredictor::update(GameState* state) {
+	PROFILE_ZONE("TrajectoryPredictor::update");
+	integratedLastTick = 0;
+	PlayerShip* player = state->player;
+	if (player == nullptr or state->gamePause) {
+		return;
+	}
+	clock += state->deltaT;
+	// braking and parking follow a body rather than gravity, there is no path to show
+	if (player->isParked() or player->isBraking()) {
+		clear();
+		return;
+	}
+
+	bool startOver = count == 0 or state != lastState or !(player->getPlayerDelta() == lastThrust)
+		or plans.bodies.size() != state->staticGravBodies.size() + state->dynamicGravBodies.size();
+	if (!startOver) {
+		// shift the window, the last point passed is kept to measure the player against
+		while (count > 1 and at(1).time <= clock) {
+			first = (first + 1) % TRAJECTORYPOINTS;
+			count--;
+		}
+		if (count > 1) {
+			const TrajectoryPoint& from = at(0);
+			const TrajectoryPoint& to = at(1);
+			double along = (clock - from.time) / (to.time - from.time);
+			Vector2D expected = from.location + (to.location - from.location) * along;
+			// a collision, a reset, crossing into another sector or the path just drifting off
+			startOver = (player->getLocation() - expected).magnitude() > TRAJECTORYTOLERANCE;
+		}
+		else {
+			startOver = true; // everything ahead has been passed, the path had run into something
+		}
+	}
+
+	if (startOver) {
+		restart(state);
+	}
+	else if (plansStale(state)) {
+		capturePlans(state);
+		truncate(clock + TRAJECTORYBODYKEEP);
+	}
+
+	while (count < TRAJECTORYPOINTS and !blocked and integratedLastTick < TRAJECTORYPERTICK) {
+		TrajectoryPoint next;
+		if (!step(state, at(count - 1), next)) {
+			blocked = true;
+			break;
+		}
+		at(count) = next;
+		count++;
+		integratedLastTick++;
+	}
+}
+
+void TrajectoryPredictor::getPath(std::vector<Vector2D>& out) {
+	// the first point has already been passed, the renderer starts the path at the player
+	out.resize(count > 1 ? count - 1 : 0);
+	for (int i = 1; i < count; i++) {
+		out[i - 1] = at(i).location;
+	}
+}
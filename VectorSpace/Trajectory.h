@@ -0,0 +1,78 @@
+/*
+* The path the player will take if they keep doing what they are doing, drawn ahead of the ship.
+* Points are integrated TRAJECTORYSTEP apart under the same gravity as doGravity, with every body where it will be
+* at the point's time: orbits (moveType 1) are worked out exactly and anything else is carried on along its speed
+* and acceleration. The path is kept between ticks. Each tick drops the points that have been passed and integrates
+* a few more at the end, only the part that input or a body straying has made wrong is integrated again.
+*/
+
+#pragma once
+#include <vector>
+
+#include "BSLA.h"
+
+struct GameState;
+class Body;
+
+static const double TRAJECTORYSTEP = 1.0 / 30; // seconds between points
+static const int TRAJECTORYSUBSTEPS = 4; // integration steps per point, close to the tick length so the path agrees with update
+static const int TRAJECTORYPOINTS = 180; // points kept ahead of the player, six seconds
+static const int TRAJECTORYPERTICK = 12; // points integrated per tick at most, a path started over fills in over a few ticks
+static const double TRAJECTORYTOLERANCE = 4; // world units the player can be off the path before it is started over
+static const double TRAJECTORYBODYSLACK = 8; // world units a body can be off where the path assumed before the path is redone
+static const double TRAJECTORYBODYKEEP = 0.5; // seconds of path kept when a body strays, that close it has hardly pulled differently
+
+struct TrajectoryPoint {
+	Vector2D location;
+	Vector2D speed;
+	double time = 0; // on the predictor's clock
+};
+
+class TrajectoryPredictor {
+private:
+	// Every body as the path assumes it moves, in state->bodyLanes order with the padding left out.
+	enum PlanKind : char { PlanStatic, PlanOrbit, PlanCarried };
+	struct BodyPlans {
+		std::vector<char> kind;
+		std::vector<Vector2D> location, speed, accel; // when captured, accel only for PlanCarried
+		std::vector<simScalar> mass, radius;
+		std::vector<char> dynamic; // dynamic bodies pull along the signs of the direction to them, see doGravity
+		std::vector<int> orbitIndex; // PlanOrbit, the plan of the body orbited
+		std::vector<double> orbitTime, orbitRate, orbitStart, orbitEnd; // PlanOrbit, DynamicGravBody's timeCur and friends
+		std::vector<simScalar> orbitX, orbitY; // PlanOrbit, XMul and YMul
+		std::vector<Body*> bodies;
+		double captured = 0; // clock when captured
+	};
+	BodyPlans plans;
+	std::vector<Vector2D> futureFrom, futureTo; // scratch, every body at the ends of a step
+	double futureToTime = -1; // futureTo is kept for the next step when it starts there
+	std::vector<Vector2D> future; // scratch, every body part way through a step
+
+	TrajectoryPoint points[TRAJECTORYPOINTS];
+	int first = 0; // ring start
+	int count = 0;
+	double clock = 0; // seconds this predictor has been ticked for
+	bool blocked = false; // the path ends in a body
+	GameState* lastState = nullptr;
+	Vector2D lastThrust;
+
+	TrajectoryPoint& at(int index) { return points[(first + index) % TRAJECTORYPOINTS]; }
+	void capturePlans(GameState* state);
+	bool plansStale(GameState* state);
+	void bodiesAt(double time, std::vector<Vector2D>& out);
+	Vector2D gravityAt(Vector2D location);
+	Body* insideBody(Vector2D location);
+	bool step(GameState* state, const TrajectoryPoint& from, TrajectoryPoint& to);
+	void restart(GameState* state);
+	void truncate(double after);
+public:
+	// Brings the path up to date with the tick that just ran, call once per tick after update on the player's sector.
+	void update(GameState* state);
+	void clear() { count = 0; blocked = false; }
+	// true when the path runs into a body rather than just ending
+	bool endsBlocked() { return blocked; }
+	// The path from the player's location on, out is resized to fit.
+	void getPath(std::vector<Vector2D>& out);
+	int integratedLastTick = 0;
+	int restarts = 0;
+};
@@ -2,16 +2,28 @@
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
 #include <SDL3_image/SDL_image.h>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
 #include "GameData.h"
 #include "Shapes.h"
 #include "BSLA.h"
+#include "Text.h"
+#include "Simulation.h"
+#include "Profiler.h"
+#include "Batch.h"
+#include "Background.h"
+#include "FramePacer.h"
 
 static SDL_Window* window = NULL;
 static SDL_Renderer* renderer = NULL;
 static SDL_Texture* letterTexture = NULL;
+static TextCache textCache;
+static BackgroundCache background;
+static FramePacer pacer;
+static Simulation simulation;
 
 static double WINSCALE;
 static int WINLENGTH = 1050;
@@ -19,16 +31,29 @@ static int WINHEIGHT = 800;
 
 const bool* key_board_state = SDL_GetKeyboardState(NULL);
 
-bool update(GameState* gameState);
-void cleaner(GameState* gameState);
 void renderMenu(GameState* gameState);
-void renderGame(GameState* gameState);
-void renderText(std::string text, int x, int y, int kerning, int FontSize);
+void startPlay(GameState* gameState);
+void renderGame(RenderSnapshot& snapshot);
+void sendViewSize();
+void sendHeldKeys(bool force = false);
+void renderText(const std::string& text, int x, int y, int kerning, int FontSize);
+#ifdef VS_PROFILE
+void renderProfiler();
+static const int TRACEFRAMES = 120; // frames written by the trace key
+#endif
 
 Uint64 DTNOW = SDL_GetPerformanceCounter();
 Uint64 DTLAST = 0;
+static float renderDeltaT = 0;
+// copied from the GameState when play starts, the simulation thread owns the GameState after that
+static bool debugMode = true;
 SDL_AppResult SDL_AppInit(void** appstate, int argc, char* argv[])
 {
+    // headless, runs the worlds and exits without opening a window
+    if (isBatchCommand(argc, argv)) {
+        return runBatch(argc, argv) == 0 ? SDL_APP_SUCCESS : SDL_APP_FAILURE;
+    }
+
     /* Create the window */
     if (!SDL_CreateWindowAndRenderer("Vector Space", WINLENGTH, WINHEIGHT, SDL_WINDOW_KEYBOARD_GRABBED, &window, &renderer)) {
         SDL_Log("Couldn't create window and renderer: %s\n", SDL_GetError());
@@ -39,6 +64,15 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char* argv[])
     SDL_SetRenderScale(renderer, WINSCALE, WINSCALE);
 
     SDL_StartTextInput(window);
+
+    // --fps N holds the frame rate to N, 0 renders as fast as it can
+    double frameRate = PACERDEFAULTRATE;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--fps") == 0) {
+            frameRate = atof(argv[i + 1]);
+        }
+    }
+    pacer.setRate(frameRate);
     
     SDL_Surface* textBMPSurf = SDL_LoadBMP("Resources/font.bmp");
     letterTexture = SDL_CreateTextureFromSurface(renderer, textBMPSurf);
@@ -47,6 +81,7 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char* argv[])
         return SDL_APP_FAILURE;
     }
     SDL_DestroySurface(textBMPSurf);
+    textCache.setFont(letterTexture);
 
     GameState* gameState = new GameState;
     gameState->resetFlag = false;
@@ -58,6 +93,7 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char* argv[])
     gameState->debugMode = true;
     gameState->player = new PlayerShip();
     gameState->entityCap = 0;
+    gameState->events.subscribe(logEvent);
 
     gameState->deltaT = 0;
     DTNOW = SDL_GetPerformanceCounter();
@@ -69,15 +105,18 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char* argv[])
 void SDL_AppQuit(void* appstate, SDL_AppResult result)
 {
     GameState* gameState = static_cast<GameState*> (appstate);
+    if (gameState == nullptr) { // a batch run, nothing was created
+        return;
+    }
+    simulation.stop();
+    delete gameState->generator; // quit while the world was still being built
+    gameState->generator = nullptr;
     for (auto body : gameState->staticGravBodies) {
         delete body;
     }
     for (auto body : gameState->dynamicGravBodies) {
         delete body;
     }
-    for (auto navObj : gameState->entities) {
-        delete navObj;
-    }
     for (auto city : gameState->cities) {
         delete city;
     }
@@ -85,10 +124,13 @@ void SDL_AppQuit(void* appstate, SDL_AppResult result)
     gameState->dynamicGravBodies.clear();
     gameState->entities.clear();
     gameState->cities.clear();
-    gameState->eventStack.clear();
+    gameState->events.clear();
     delete gameState->player;
     delete gameState;
 
+    textCache.clear();
+    background.clear();
+    SDL_DestroyTexture(letterTexture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     
@@ -104,10 +146,22 @@ SDL_AppResult SDL_AppEvent(void* appstate, SDL_Event* event)
     if (event->type == SDL_EVENT_WINDOW_RESIZED) {
         SDL_GetWindowSize(window, &WINLENGTH, &WINHEIGHT);
         SDL_SetRenderScale(renderer, WINSCALE, WINSCALE);
+        sendViewSize();
     }
+#ifdef VS_PROFILE
+    if (event->type == SDL_EVENT_KEY_DOWN and event->key.key == SDLK_F3) {
+        Profiler::writeChromeTrace("trace.json", TRACEFRAMES);
+    }
+#endif
 
+    // while the simulation thread is running it owns the GameState, play input is sent to it as commands
+    Stage stage = StagePlay;
+    if (!simulation.isActive()) {
+        stage = gameState->curState;
+    }
 
-    switch (gameState->curState)
+
+    switch (stage)
     {
     case StageStart:
         if (event->type == SDL_EVENT_KEY_DOWN) {
@@ -115,11 +169,12 @@ SDL_AppResult SDL_AppEvent(void* appstate, SDL_Event* event)
                 switch (gameState->menuSelectorY)
                 {
                 case 0:
+                    if (gameState->generator != nullptr) {
+                        break; // already building, play starts from SDL_AppIterate
+                    }
                     gameState->seed = std::stoi(gameState->seedStringBuffer);
                     
-                    generatePlaySpace(1000, 500, gameState->seed, gameState);
-
-                    gameState->curState = StagePlay;
+                    startWorldGeneration(1000, 500, gameState->seed, gameState);
                     break;
                 case 1:
                     break;
@@ -179,41 +234,26 @@ SDL_AppResult SDL_AppEvent(void* appstate, SDL_Event* event)
         }
         break;
     case StagePlay:
-        if (gameState->gamePause) {
-            if (event->type == SDL_EVENT_KEY_DOWN) {
-                if (key_board_state[SDL_SCANCODE_P]) {
-                    gameState->gamePause = false;
-                    std::cout << "unpause\n";
-                }
+    {
+        InputCommand command;
+        if (event->type == SDL_EVENT_KEY_DOWN) {
+            if (key_board_state[SDL_SCANCODE_P]) {
+                command.type = InputCommand::TogglePause;
+                simulation.pushCommand(command);
             }
-            return SDL_APP_CONTINUE;
-        }
-
-        if (key_board_state[SDL_SCANCODE_Q]) {
-            gameState->player->setThrustDir(-1); // TODO: this needs to tell a flag in update to increment thrust
-        } else if (key_board_state[SDL_SCANCODE_E]) {
-            gameState->player->setThrustDir(1);
-        }
-        else {
-            gameState->player->setThrustDir(0);
         }
 
         if (key_board_state[SDL_SCANCODE_DOWN]) {
-            gameState->player->lockonClosest(gameState, 400);
-        }
-        
-        if (event->type == SDL_EVENT_KEY_DOWN) {
-            if (key_board_state[SDL_SCANCODE_P]) {
-                gameState->gamePause = true;
-                std::cout << "pause\n";
-            }
+            command.type = InputCommand::LockOn;
+            simulation.pushCommand(command);
         }
 
         if (event->type == SDL_EVENT_KEY_DOWN) {
             switch (event->key.key)
             {
             case SDLK_SPACE:
-                gameState->player->doBrake();
+                command.type = InputCommand::BrakeOn;
+                simulation.pushCommand(command);
                 break;
             default:
                 break;
@@ -223,13 +263,15 @@ SDL_AppResult SDL_AppEvent(void* appstate, SDL_Event* event)
             switch (event->key.key)
             {
             case SDLK_SPACE:
-                gameState->player->unbrake();
+                command.type = InputCommand::BrakeOff;
+                simulation.pushCommand(command);
                 break;
             default:
                 break;
             }
         }
 
+    }
         break;
     default:
         break;
@@ -238,63 +280,6 @@ SDL_AppResult SDL_AppEvent(void* appstate, SDL_Event* event)
     return SDL_APP_CONTINUE;
 }
 
-/*
-* For input that should not use an event, 
-* this will run with every update while in play
-*/
-void handleInput(void* appstate) {
-    GameState* gameState = static_cast<GameState*> (appstate);
-
-    // movement
-    Vector2D moveVect(0, 0);
-    double pMoveSpeed = gameState->player->getThrust();
-
-    if (key_board_state[SDL_SCANCODE_LEFT]) {
-        gameState->player->incrementLockLead(-gameState->deltaT * 100);
-    }
-    else if (key_board_state[SDL_SCANCODE_RIGHT]) {
-        gameState->player->incrementLockLead(gameState->deltaT * 100);
-    }
-
-    if (key_board_state[SDL_SCANCODE_W]) {
-        moveVect = moveVect + Vector2D(0, -pMoveSpeed);
-    }
-    if (key_board_state[SDL_SCANCODE_S]) {
-        moveVect = moveVect + Vector2D(0, pMoveSpeed);
-    }
-    if (key_board_state[SDL_SCANCODE_A]) {
-        moveVect = moveVect + Vector2D(-pMoveSpeed, 0);
-    }
-    if (key_board_state[SDL_SCANCODE_D]) {
-        moveVect = moveVect + Vector2D(pMoveSpeed, 0);
-    }
-
-    gameState->player->deltaSpeed(moveVect);
-
-
-    // shooting
-    if (key_board_state[SDL_SCANCODE_UP]) {
-        // TODO: There should just be a number of these loaded always, that are pulled in and out of the game
-        // that way there are not slowdowns for creating and deleting many objects
-        Vector2D playerSpeed = gameState->player->getSpeed();
-        if (gameState->player->getLockedOn() != nullptr) {
-            float playerLockOnLead = gameState->player->getLockOnLead();
-            Vector2D locSpeed = gameState->player->getLockedOn()->getLocation() + ((gameState->player->getLockedOn()->getNav()->getSpeed() * gameState->deltaT) * playerLockOnLead);
-            Vector2D dir = (locSpeed - gameState->player->getLocation()).normalize();
-            gameState->projectiles.push_back(new Projectile(gameState->player->getLocation(), playerSpeed + dir * 1000, 16, 0.1));
-        }
-        else {
-            Vector2D playerDir = moveVect.normalize();
-            if (moveVect.magnitude() == 0) {
-                gameState->projectiles.push_back(new Projectile(gameState->player->getLocation(), playerSpeed + Vector2D(1000,0), 16, 0.1));
-            }
-            else {
-                gameState->projectiles.push_back(new Projectile(gameState->player->getLocation(), playerSpeed + playerDir * 1000, 16, 0.1));
-            }
-        }
-    }
-}
-
 
 SDL_AppResult SDL_AppIterate(void* appstate)
 {
@@ -304,164 +289,80 @@ SDL_AppResult SDL_AppIterate(void* appstate)
     //Calculate deltaT
     DTLAST = DTNOW;
     DTNOW = SDL_GetPerformanceCounter();
-    gameState->deltaT = ((DTNOW - DTLAST) / (float)SDL_GetPerformanceFrequency());
+    renderDeltaT = ((DTNOW - DTLAST) / (float)SDL_GetPerformanceFrequency());
 
-    if (!update(gameState)) {
-        return SDL_APP_SUCCESS;
+    // the game reset back to the menu, the GameState is ours again once the thread is joined
+    if (simulation.hasFinished()) {
+        simulation.stop();
     }
-    switch (gameState->curState)
-    {
-    case StageStart:
-        renderMenu(gameState);
-        break;
-    case StagePlay:
-        renderGame(gameState);
-        break;
-    default:
-        break;
-    }
-
-    //SDL_Delay(floor(16.666f - gameState->deltaT));
-    return SDL_APP_CONTINUE;
-}
-
-bool update(GameState* gameState) {
-    switch (gameState->curState)
-    {
-    case StageStart:
-        break;
-    case StagePlay:
-        if (gameState->resetFlag) {
-            resetGameState(gameState);
-            return true;
-        }
-
-        if (gameState->gamePause) {
-            // TODO: this needs to be more robust
-
-            // cleanup
-            cleaner(gameState);
-            return true;
-        }
-
-        handleInput(gameState);
-
-        // if the entity count is less than entity cap we should make some
-        if ((int)gameState->entities.size() < gameState->entityCap) {
-            int pick = rand() % 4;
-            if (pick == 3) {
-                // chose to create pirate
-                Entity* newPirate = (Entity*) new EntityPirate(EntityPirate::AIBehavior::Driveby);
-                int bound = AREASIZE * 2;
-                newPirate->getNav()->forceLocation(Vector2D((rand() % bound) - AREASIZE, (rand() % bound) - AREASIZE));
-                newPirate->getNav()->setDestination(Vector2D((rand() % bound) - AREASIZE, (rand() % bound) - AREASIZE));
-                gameState->entities.push_back((Entity*)newPirate);
-                std::cout << "Created a new pirate\n";
-            }
-            else {
-                // chose to create neutral entity
-                Entity* newCargo = (Entity*) new EntityCargo();
-                int bound = AREASIZE * 2;
-                newCargo->getNav()->forceLocation(Vector2D((rand() % bound) - AREASIZE, (rand() % bound) - AREASIZE));
-                newCargo->getNav()->setDestination(Vector2D((rand() % bound) - AREASIZE, (rand() % bound) - AREASIZE));
-                gameState->entities.push_back((Entity*)newCargo);
-                std::cout << "Created a new entity\n";
-
-            }
-        }
-
 
-        for (auto body : gameState->dynamicGravBodies) {
-            body->update(gameState);
-        }
-        for (int i = 0; i < gameState->projectiles.size(); i++) {
-            Projectile* projectile = gameState->projectiles[i];
-            int r = projectile->update(gameState);
-        }
-        for (auto entityUncast : gameState->entities) {
-            switch (entityUncast->getType())
-            {
-            case 'b':
-            {
-                entityUncast->update(gameState);
-                break;
-            }
-            case 'c':
-            {
-                EntityCargo* entityCargo = (EntityCargo*)entityUncast;
-                entityCargo->update(gameState);
-                break;
-            }
-            case 'p':
-            {
-                EntityPirate* entityPirate = (EntityPirate*)entityUncast;
-                entityPirate->update(gameState);
-                break;
-            }
-            }
-        }
-        for (auto city : gameState->cities) {
-            city->update(gameState);
+    // update() runs on the simulation thread, this only draws the newest snapshot it has published
+    if (simulation.isActive()) {
+        sendHeldKeys();
+        renderGame(simulation.latestSnapshot());
+    }
+    else {
+        // the world is built in the background, play starts once the systems around the spawn are in
+        if (gameState->generator != nullptr and (adoptGeneratedWorld(gameState) or gameState->generator->isReady())) {
+            startPlay(gameState);
         }
-        gameState->player->update(gameState);
-
-        // events
-        if (!gameState->eventStack.empty()) {
-            std::string currentEvent = gameState->eventStack.back();
-            std::cout << currentEvent << "\n";
-            gameState->eventStack.pop_back();
+        else {
+            renderMenu(gameState);
         }
-
-        // cleanup
-        cleaner(gameState);
-        break;
-    default:
-        break;
     }
 
-    return true;
+    PROFILE_FRAME();
+    pacer.wait();
+    return SDL_APP_CONTINUE;
 }
 
-/* Cleans up the gamestate after each frame in play.
-*  This could be deferred 
-*/
-void cleaner(GameState* gameState) {
-    // TODO: This shit needs to be looked at for memory leaks.
-    // I anticipate a lot of crashes and other issues from this code
-
-    // Cleans dead entities
-    for (int iter = 0; iter < gameState->entities.size();) {
-        Entity* curEntity = gameState->entities[iter];
-        if (curEntity->isToClean()) {
-            if (gameState->player->getLockedOn() == curEntity) {
-                gameState->player->unlockLockon();
-            }
-
-
-
-            gameState->entities.erase(gameState->entities.begin() + iter);
+// Hands the GameState to the simulation thread, the rest of the world streams in from its generator.
+void startPlay(GameState* gameState) {
+    gameState->curState = StagePlay;
+    debugMode = gameState->debugMode;
+    background.setSeed(gameState->seed);
+    simulation.start(gameState);
+    sendViewSize();
+    sendHeldKeys(true);
+}
 
-            delete curEntity;
-            curEntity = nullptr;
-        }
-        else {
-            iter++;
-        }
-    }
-    // cleans projectiles
-    for (int iter = 0; iter < gameState->projectiles.size();) {
-        Projectile* curProjectile = gameState->projectiles[iter];
-        if (curProjectile->isCull()) {
-            gameState->projectiles.erase(gameState->projectiles.begin() + iter);
+// Tells the simulation where the player is drawn and how much of the world fits in the window.
+void sendViewSize() {
+    if (!simulation.isActive()) {
+        return;
+    }
+    float scaleX = 1; float scaleY = 1;
+    SDL_GetRenderScale(renderer, &scaleX, &scaleY);
+    InputCommand command;
+    command.type = InputCommand::ViewSize;
+    command.offsetX = WINLENGTH / 2; command.offsetY = WINHEIGHT / 2;
+    command.width = WINLENGTH / scaleX; command.height = WINHEIGHT / scaleY;
+    simulation.pushCommand(command);
+}
 
-            delete curProjectile;
-            curProjectile = nullptr;
-        }
-        else {
-            iter++;
+// Samples the keys handleInput reads every tick and sends them if they changed.
+void sendHeldKeys(bool force) {
+    static unsigned int lastKeys = 0;
+    unsigned int keys = 0;
+    if (key_board_state[SDL_SCANCODE_W]) keys |= HeldW;
+    if (key_board_state[SDL_SCANCODE_A]) keys |= HeldA;
+    if (key_board_state[SDL_SCANCODE_S]) keys |= HeldS;
+    if (key_board_state[SDL_SCANCODE_D]) keys |= HeldD;
+    if (key_board_state[SDL_SCANCODE_Q]) keys |= HeldQ;
+    if (key_board_state[SDL_SCANCODE_E]) keys |= HeldE;
+    if (key_board_state[SDL_SCANCODE_UP]) keys |= HeldUp;
+    if (key_board_state[SDL_SCANCODE_LEFT]) keys |= HeldLeft;
+    if (key_board_state[SDL_SCANCODE_RIGHT]) keys |= HeldRight;
+
+    // a dropped command is sent again next frame
+    if (keys != lastKeys or force) {
+        InputCommand command;
+        command.type = InputCommand::HeldKeys;
+        command.keys = keys;
+        if (simulation.pushCommand(command)) {
+            lastKeys = keys;
         }
     }
-    gameState->projectiles.shrink_to_fit();
 }
 
 void renderMenu(GameState* gameState) {
@@ -484,6 +385,17 @@ void renderMenu(GameState* gameState) {
         renderText("Debug Mode false", 30, 140, 20, 20);
     }
 
+    if (gameState->generator != nullptr) {
+        WorldGenerator* generator = gameState->generator;
+        renderText("Building systems " + std::to_string(generator->systemsBuilt()) + " of " + std::to_string(generator->systemCount()), 30, 200, 20, 20);
+        SDL_FRect bar = { 30, 230, 400, 10 };
+        SDL_RenderRect(renderer, &bar);
+        if (generator->systemCount() > 0) {
+            bar.w = 400.0f * generator->systemsBuilt() / generator->systemCount();
+            SDL_RenderFillRect(renderer, &bar);
+        }
+    }
+
     if (gameState->menuSelectorY == 0) {
         drawCircle(renderer, 15, 46, 8);
     }
@@ -491,6 +403,7 @@ void renderMenu(GameState* gameState) {
         drawCircle(renderer, 15, 110 + 40 * (gameState->menuSelectorY - 1), 8);
     }
 
+    textCache.flush(renderer);
     SDL_RenderPresent(renderer);
 }
 
@@ -498,166 +411,208 @@ void renderEventPopup(){
     //TODO:
 }
 
-void renderGame(GameState* gameState) {
+void renderGame(RenderSnapshot& snapshot) {
+    PROFILE_ZONE("renderGame");
+    static std::vector<TextLabel> cityLabels;
+    static TextLabel hudLabels[15];
+
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
     SDL_RenderClear(renderer);
     SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
 
-    double pxoffset = gameState->player->getLocation().x - WINLENGTH / 2;
-    double pyoffset = gameState->player->getLocation().y - WINHEIGHT / 2;
+    // the snapshot only holds what was inside the view when it was taken, see Simulation::buildSnapshot
+    double pxoffset = snapshot.playerLocation.x - WINLENGTH / 2;
+    double pyoffset = snapshot.playerLocation.y - WINHEIGHT / 2;
 
     // Draw background
-    // TODO:
+    // from the world's position across every sector so the sky carries on when the player crosses into the next
+    float scaleX = 1; float scaleY = 1;
+    SDL_GetRenderScale(renderer, &scaleX, &scaleY);
+    double sectorLeft = (snapshot.sectorX - SECTORGRID / 2) * 2 * AREASIZE;
+    double sectorTop = (snapshot.sectorY - SECTORGRID / 2) * 2 * AREASIZE;
+    background.draw(renderer, pxoffset + sectorLeft, pyoffset + sectorTop, WINLENGTH / scaleX, WINHEIGHT / scaleY);
+
+    // Draw the path ahead, fading out the further it goes
+    static std::vector<SDL_FPoint> pathPoints;
+    pathPoints.resize(snapshot.trajectory.size() + 1);
+    pathPoints[0] = { (float)(WINLENGTH / 2), (float)(WINHEIGHT / 2) };
+    for (int i = 0; i < (int)snapshot.trajectory.size(); i++) {
+        pathPoints[i + 1] = { (float)(snapshot.trajectory[i].x - pxoffset), (float)(snapshot.trajectory[i].y - pyoffset) };
+    }
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    const int pathPieces = 3;
+    int pieceLength = (int)pathPoints.size() / pathPieces + 1;
+    for (int piece = 0; piece < pathPieces; piece++) {
+        int start = piece * pieceLength;
+        int length = std::min(pieceLength + 1, (int)pathPoints.size() - start);
+        if (length < 2) {
+            break;
+        }
+        SDL_SetRenderDrawColor(renderer, 0x60, 0xA0, 0xFF, (Uint8)(0xC0 - piece * 0x38));
+        SDL_RenderLines(renderer, &pathPoints[start], length);
+    }
+    if (snapshot.trajectoryBlocked and pathPoints.size() > 1) {
+        SDL_SetRenderDrawColor(renderer, 0xFF, 0x60, 0x40, 0xFF);
+        drawSquare(renderer, pathPoints.back().x, pathPoints.back().y, 6);
+    }
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+    SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
 
     // Draw Player
     drawTriangle(renderer, WINLENGTH/2, WINHEIGHT/2, 12);
     // Draw around locked on
-    if (gameState->player->getLockedOn() != nullptr) {
-        Entity* lockedOn = gameState->player->getLockedOn();
-        float playerLockOnLead = gameState->player->getLockOnLead();
-        Vector2D locSpeed = gameState->player->getLockedOn()->getLocation() + ((gameState->player->getLockedOn()->getNav()->getSpeed() * gameState->deltaT) * playerLockOnLead);
-        drawSquare(renderer, lockedOn->getLocation().x - pxoffset, lockedOn->getLocation().y - pyoffset, 10);
-        drawSquare(renderer, locSpeed.x - pxoffset, locSpeed.y - pyoffset, 10);
+    if (snapshot.hasLockOn) {
+        drawSquare(renderer, snapshot.lockOnLocation.x - pxoffset, snapshot.lockOnLocation.y - pyoffset, 10);
+        drawSquare(renderer, snapshot.lockOnLeadLocation.x - pxoffset, snapshot.lockOnLeadLocation.y - pyoffset, 10);
     }
 
     // Draw entities objects
-    for (auto entity : gameState->entities) {
-        double dist = (entity->getLocation() - gameState->player->getLocation()).magnitude();
-        if (dist < WINLENGTH) {
-
-            switch (entity->getFaction())
-            {
-            case 'e':
-                SDL_SetRenderDrawColor(renderer, 0xFF, 0x0, 0x0, 0xFF);
-                break;
-            default:
-                break;
-            }
-
-            NavigationObject* navObj = entity->getNav();
-            drawTriangle(renderer, navObj->getLocation().x - pxoffset, navObj->getLocation().y - pyoffset, 12);
-            SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-            if (gameState->debugMode) {
-                SDL_RenderLine(renderer, navObj->getLocation().x - pxoffset, navObj->getLocation().y - pyoffset,
-                    navObj->getD().x - pxoffset, navObj->getD().y - pyoffset);
-                SDL_RenderLine(renderer, navObj->getLocation().x - pxoffset, navObj->getLocation().y - pyoffset,
-                    navObj->getCD().x - pxoffset, navObj->getCD().y - pyoffset);
-                if (navObj->closestBody != nullptr) {
-                    Vector2D dVect = navObj->closestBody->location - navObj->getLocation();
-                    Vector2D lineVect = navObj->getD() - navObj->getLocation();
-                    Vector2D lineVecrProj;
-                    lineVecrProj = dVect.proj(lineVect);
-                    SDL_SetRenderDrawColor(renderer, 0, 0xFF, 0, 0);
-                    SDL_RenderLine(renderer, navObj->getLocation().x - pxoffset, navObj->getLocation().y - pyoffset,
-                        navObj->getLocation().x + dVect.x - pxoffset, navObj->getLocation().y + dVect.y - pyoffset);
-                    SDL_SetRenderDrawColor(renderer, 0, 0, 0xFF, 0);
-                    SDL_RenderLine(renderer, navObj->getLocation().x - pxoffset, navObj->getLocation().y - pyoffset,
-                        navObj->getLocation().x + lineVect.x - pxoffset, navObj->getLocation().y + lineVect.y - pyoffset);
-                    SDL_SetRenderDrawColor(renderer, 0xFF, 0, 0, 0);
-                    SDL_RenderLine(renderer, navObj->getLocation().x - pxoffset, navObj->getLocation().y - pyoffset,
-                        navObj->getLocation().x + lineVecrProj.x - pxoffset, navObj->getLocation().y + lineVecrProj.y - pyoffset);
-                    SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-                }
+    for (SnapshotEntity& entity : snapshot.entities) {
+        switch (entity.faction)
+        {
+        case 'e':
+            SDL_SetRenderDrawColor(renderer, 0xFF, 0x0, 0x0, 0xFF);
+            break;
+        default:
+            break;
+        }
+
+        drawTriangle(renderer, entity.location.x - pxoffset, entity.location.y - pyoffset, 12);
+        SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+        if (debugMode) {
+            SDL_RenderLine(renderer, entity.location.x - pxoffset, entity.location.y - pyoffset,
+                entity.destination.x - pxoffset, entity.destination.y - pyoffset);
+            SDL_RenderLine(renderer, entity.location.x - pxoffset, entity.location.y - pyoffset,
+                entity.currentDest.x - pxoffset, entity.currentDest.y - pyoffset);
+            if (entity.hasClosestBody) {
+                Vector2D dVect = entity.closestBodyLocation - entity.location;
+                Vector2D lineVect = entity.destination - entity.location;
+                Vector2D lineVecrProj;
+                lineVecrProj = dVect.proj(lineVect);
+                SDL_SetRenderDrawColor(renderer, 0, 0xFF, 0, 0);
+                SDL_RenderLine(renderer, entity.location.x - pxoffset, entity.location.y - pyoffset,
+                    entity.location.x + dVect.x - pxoffset, entity.location.y + dVect.y - pyoffset);
+                SDL_SetRenderDrawColor(renderer, 0, 0, 0xFF, 0);
+                SDL_RenderLine(renderer, entity.location.x - pxoffset, entity.location.y - pyoffset,
+                    entity.location.x + lineVect.x - pxoffset, entity.location.y + lineVect.y - pyoffset);
+                SDL_SetRenderDrawColor(renderer, 0xFF, 0, 0, 0);
+                SDL_RenderLine(renderer, entity.location.x - pxoffset, entity.location.y - pyoffset,
+                    entity.location.x + lineVecrProj.x - pxoffset, entity.location.y + lineVecrProj.y - pyoffset);
+                SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
             }
         }
     }
 
     // draw projectiles
-    for (auto projectile : gameState->projectiles) {
-        double dist = (projectile->getLocation() - gameState->player->getLocation()).magnitude();
-        if (dist < WINLENGTH) { // check if the projectile can be seen by the player
-            drawCircle(renderer, projectile->getLocation().x - pxoffset, projectile->getLocation().y - pyoffset, 5);
-        }
+    for (Vector2D& projectile : snapshot.projectiles) {
+        drawCircle(renderer, projectile.x - pxoffset, projectile.y - pyoffset, 5);
     }
 
     // Draw Bodies
-    for (auto body : gameState->staticGravBodies) {
-        double dist = (body->location - gameState->player->getLocation()).magnitude() - body->radius;
-        if (dist < WINLENGTH) { // check if the body can be seen by the player
-            //drawCircle(renderer, body->location.x - pxoffset, body->location.y - pyoffset, body->radius);
-            drawTiltedSquare(renderer, body->location.x - pxoffset, body->location.y - pyoffset, body->radius);
-            drawSquare(renderer, body->location.x - pxoffset, body->location.y - pyoffset, body->radius * (2.0/3.0));
-        }
+    for (SnapshotBody& body : snapshot.staticBodies) {
+        //drawCircle(renderer, body.location.x - pxoffset, body.location.y - pyoffset, body.radius);
+        drawTiltedSquare(renderer, body.location.x - pxoffset, body.location.y - pyoffset, body.radius);
+        drawSquare(renderer, body.location.x - pxoffset, body.location.y - pyoffset, body.radius * (2.0/3.0));
     }
-    for (auto body : gameState->dynamicGravBodies) {
-        double dist = (body->location - gameState->player->getLocation()).magnitude() - body->radius;
-        if (dist < WINLENGTH) { // check if the body can be seen by the player
-            drawCircle(renderer, body->location.x - pxoffset, body->location.y - pyoffset, body->radius);
-        }
+    for (SnapshotBody& body : snapshot.dynamicBodies) {
+        drawCircle(renderer, body.location.x - pxoffset, body.location.y - pyoffset, body.radius);
     }
-    for (auto city : gameState->cities) {
-        Body* body = city->getTiedBody();
-        double dist = (body->location - gameState->player->getLocation()).magnitude() - body->radius;
-        if (dist < WINLENGTH) { // check if the body can be seen by the player
-            drawCity(renderer, body->location.x - pxoffset, body->location.y - pyoffset, body->radius);
-            int screenx; int screeny;
-            //if (gameState->debugMode) {
-                renderText(std::to_string(city->getID()), body->location.x - pxoffset, body->location.y - pyoffset, 12, 12);
-                renderText(std::to_string(city->getpcPS()), body->location.x - pxoffset, 12 + body->location.y - pyoffset, 12, 12);
-                renderText(std::to_string(city->getCurStorage()) + "|" + std::to_string(city->getStorageLimit()), 
-                    body->location.x - pxoffset, 24 + body->location.y - pyoffset, 12, 12);
-            //}
+    for (SnapshotCity& city : snapshot.cities) {
+        drawCity(renderer, city.location.x - pxoffset, city.location.y - pyoffset, city.radius);
+        // labels are kept per city so they are only reformatted when a value changes
+        if ((int)cityLabels.size() < snapshot.cityCount * 3) {
+            cityLabels.resize(snapshot.cityCount * 3);
         }
+        TextLabel* labels = &cityLabels[city.id * 3];
+        //if (debugMode) {
+            renderText(labels[0].integer("", city.id), city.location.x - pxoffset, city.location.y - pyoffset, 12, 12);
+            renderText(labels[1].number("", city.pcPS), city.location.x - pxoffset, 12 + city.location.y - pyoffset, 12, 12);
+            renderText(labels[2].ratio(city.storage, city.storageLimit),
+                city.location.x - pxoffset, 24 + city.location.y - pyoffset, 12, 12);
+        //}
     }
 
     // Draw UI
-    if (gameState->debugMode) {
-        renderText("Player Location" + gameState->player->getLocation().toString(), 10, 10, 12, 12);
-        renderText("Player Speed   " + gameState->player->getSpeed().toString(), 10, 30, 12, 12);
-        renderText("Gravity Vector " + gameState->player->getGravDelta().toString(), 10, 50, 12, 12);
-        renderText("Movement Vector" + gameState->player->getPlayerDelta().toString(), 10, 70, 12, 12);
-        renderText("Thrust " + std::to_string(gameState->player->getThrust()), 10, 90, 12, 12);
-        renderText("Player Health " + std::to_string(gameState->player->getHealth()), 10, 110, 12, 12);
-        renderText("WinHeight " + std::to_string(WINHEIGHT), 10, 130, 12, 12);
-        renderText("WinLength " + std::to_string(WINLENGTH), 10, 150, 12, 12);
-        renderText("Entity Count " + std::to_string(gameState->entities.size()), 10, 170, 12, 12);
-        renderText("Lockon Lead " + std::to_string(gameState->player->getLockOnLead()), 10, 190, 12, 12);
-        renderText("Dt " + std::to_string(gameState->deltaT), 10, 750, 12, 12);
-        if (gameState->player->isParked()) {
+    if (debugMode) {
+        renderText(hudLabels[0].pair("Player Location", snapshot.playerLocation.x, snapshot.playerLocation.y), 10, 10, 12, 12);
+        renderText(hudLabels[1].pair("Player Speed   ", snapshot.playerSpeed.x, snapshot.playerSpeed.y), 10, 30, 12, 12);
+        renderText(hudLabels[2].pair("Gravity Vector ", snapshot.gravDelta.x, snapshot.gravDelta.y), 10, 50, 12, 12);
+        renderText(hudLabels[3].pair("Movement Vector", snapshot.playerDelta.x, snapshot.playerDelta.y), 10, 70, 12, 12);
+        renderText(hudLabels[4].number("Thrust ", snapshot.thrust), 10, 90, 12, 12);
+        renderText(hudLabels[5].integer("Player Health ", snapshot.health), 10, 110, 12, 12);
+        renderText(hudLabels[6].integer("WinHeight ", WINHEIGHT), 10, 130, 12, 12);
+        renderText(hudLabels[7].integer("WinLength ", WINLENGTH), 10, 150, 12, 12);
+        renderText(hudLabels[8].integer("Entity Count ", snapshot.entityCount), 10, 170, 12, 12);
+        renderText(hudLabels[9].number("Lockon Lead ", snapshot.lockOnLead), 10, 190, 12, 12);
+        renderText(hudLabels[12].pair("Sector ", snapshot.sectorX, snapshot.sectorY), 10, 210, 12, 12);
+        renderText(hudLabels[14].integer("Entities Asleep ", snapshot.entitiesAsleep), 10, 230, 12, 12);
+        PacerStats pacing;
+        pacer.getStats(pacing);
+        renderText(hudLabels[13].pair("Frame ms, Jitter ms ", pacing.average, pacing.jitter), 10, 730, 12, 12);
+        renderText(hudLabels[10].number("Dt ", snapshot.deltaT), 10, 750, 12, 12);
+        renderText(hudLabels[11].number("Render Dt ", renderDeltaT), 10, 770, 12, 12);
+        if (snapshot.parked) {
             renderText("parked = true", 600, 5, 12, 12);
         }
         else {
             renderText("parked = false", 600, 5, 12, 12);
         }
-        if (gameState->player->isParked()) {
+        if (snapshot.parked) {
             renderText("moving = true", 600, 40, 12, 12);
         }
         else {
             renderText("moving = false", 600, 40, 12, 12);
         }
+#ifdef VS_PROFILE
+        renderProfiler();
+#endif
     }
     else {
-        renderText("Location " + gameState->player->getLocation().toString(), 10, 10, 12, 12);
-        renderText("Thrust   " + std::to_string(gameState->player->getThrust()), 10, 30, 12, 12);
-        renderText("Health   " + std::to_string(gameState->player->getHealth()), 10, 50, 12, 12);
+        renderText(hudLabels[0].pair("Location ", snapshot.playerLocation.x, snapshot.playerLocation.y), 10, 10, 12, 12);
+        renderText(hudLabels[4].number("Thrust   ", snapshot.thrust), 10, 30, 12, 12);
+        renderText(hudLabels[5].integer("Health   ", snapshot.health), 10, 50, 12, 12);
     }
     
 
+    {
+        PROFILE_ZONE("renderText flush");
+        textCache.flush(renderer);
+    }
     SDL_RenderPresent(renderer);
 }
 
-void renderText(std::string text, int x, int y, int kerning, int FontSize) {
-    SDL_FRect rect;
-    SDL_FRect selectRect;
-    rect.x = x; rect.y = y;
-    rect.h = FontSize; rect.w = FontSize;
-    selectRect.h = 32; selectRect.w = 32;
-
-    for (char c : text) {
-        int choice = c - 32;
-        if (c == '\n') {
-            rect.y += FontSize;
-            rect.x = x;
-        }
-        if (choice < 0 || choice > 127 - 32) {
-            continue;
-        }
-        int getx = choice % 11;
-        int gety = choice / 11;
-
-        selectRect.x = getx * 32; selectRect.y = gety * 32;
+// Queues text to be drawn with the rest of the frame's glyphs, see Text.h.
+void renderText(const std::string& text, int x, int y, int kerning, int FontSize) {
+    PROFILE_ZONE("renderText");
+    textCache.queue(text, x, y, kerning, FontSize);
+}
 
-        SDL_RenderTexture(renderer, letterTexture, &selectRect, &rect);
-        rect.x += kerning;
+#ifdef VS_PROFILE
+// Per zone timings from the profiler, the text is refreshed a few times a second so it can be read.
+void renderProfiler() {
+    static std::vector<ZoneStats> stats;
+    static std::vector<std::string> lines;
+    static int refresh = 0;
+    if (refresh <= 0) {
+        refresh = 30;
+        Profiler::getStats(stats);
+        lines.clear();
+        char buffer[96];
+        for (ZoneStats& zone : stats) {
+            snprintf(buffer, sizeof(buffer), "%-20s avg %6.3f p99 %6.3f ms %4.0f allocs", zone.name, zone.average, zone.p99, zone.lastAllocations);
+            lines.push_back(buffer);
+        }
+    }
+    refresh--;
+
+    static const std::string traceHint = "F3 writes trace.json"; // too long for the small string buffer
+    static TextLabel allocLabel;
+    long long allocations; long long allocatedBytes;
+    Profiler::lastFrameAllocations(allocations, allocatedBytes);
+    renderText(traceHint, 590, 66, 10, 10);
+    renderText(allocLabel.pair("Allocs, bytes last frame ", (double)allocations, (double)allocatedBytes), 590, 80, 10, 10);
+    for (int i = 0; i < (int)lines.size(); i++) {
+        renderText(lines[i], 590, 96 + i * 14, 10, 10);
     }
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "WorkerPool.h"
+
+void WorkerPool::start(int threadCount) {
+	stop();
+	quitting = false;
+	for (int i = 0; i < threadCount; i++) {
+		threads.push_back(std::thread(&WorkerPool::threadLoop, this, i + 1));
+	}
+}
+
+void WorkerPool::stop() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quitting = true;
+	}
+	wake.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+}
+
+// Claims tasks until the batch runs out.
+void WorkerPool::takeTasks(TaskFn fn, const void* context, int tasks, int worker) {
+	for (int task = nextTask.fetch_add(1); task < tasks; task = nextTask.fetch_add(1)) {
+		fn(context, task, worker);
+	}
+}
+
+void WorkerPool::runTasks(int tasks, TaskFn fn, const void* context) {
+	if (threads.empty() or tasks <= 1) {
+		for (int task = 0; task < tasks; task++) {
+			fn(context, task, 0);
+		}
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		job = fn; jobContext = context; jobTasks = tasks;
+		nextTask.store(0);
+		busy = (int)threads.size();
+		batch++;
+	}
+	wake.notify_all();
+	takeTasks(fn, context, tasks, 0);
+
+	std::unique_lock<std::mutex> guard(lock);
+	finished.wait(guard, [this] { return busy == 0; });
+	job = nullptr; jobContext = nullptr;
+}
+
+void WorkerPool::threadLoop(int worker) {
+	unsigned int seen = 0;
+	while (true) {
+		TaskFn fn; const void* context; int tasks;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this, seen] { return quitting or batch != seen; });
+			if (quitting) {
+				return;
+			}
+			seen = batch;
+			fn = job; context = jobContext; tasks = jobTasks;
+		}
+		takeTasks(fn, context, tasks, worker);
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			busy--;
+			if (busy == 0) {
+				finished.notify_all();
+			}
+		}
+	}
+}
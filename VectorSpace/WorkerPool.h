@@ -0,0 +1,46 @@
+/*
+* A fixed set of threads that split a batch of numbered tasks between them.
+* The thread calling run() works on the batch too and run() returns once every task is done.
+*/
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+private:
+	typedef void (*TaskFn)(const void* context, int task, int worker);
+
+	std::vector<std::thread> threads;
+	std::mutex lock;
+	std::condition_variable wake; // a batch was posted or the pool is stopping
+	std::condition_variable finished; // the last thread left the batch
+	TaskFn job = nullptr;
+	const void* jobContext = nullptr;
+	int jobTasks = 0;
+	std::atomic<int> nextTask;
+	unsigned int batch = 0; // bumped for every posted batch so a thread never runs one twice
+	int busy = 0; // threads still in the current batch
+	bool quitting = false;
+
+	template <typename Fn>
+	static void callTask(const void* context, int task, int worker) { (*(const Fn*)context)(task, worker); }
+	void runTasks(int tasks, TaskFn fn, const void* context);
+	void takeTasks(TaskFn fn, const void* context, int tasks, int worker);
+	void threadLoop(int worker);
+public:
+	WorkerPool() : nextTask(0) {}
+	~WorkerPool() { stop(); }
+	// Starts threadCount threads on top of the caller, 0 runs every batch on the caller alone.
+	void start(int threadCount);
+	void stop();
+	bool isStarted() { return !threads.empty(); }
+	// The caller is worker 0, the threads are 1 to workerCount() - 1.
+	int workerCount() { return (int)threads.size() + 1; }
+	// Calls fn(task, worker) once for each task in [0, tasks), in any order and on any worker.
+	template <typename Fn>
+	void run(int tasks, const Fn& fn) { runTasks(tasks, &callTask<Fn>, &fn); }
+};
@@ -0,0 +1,204 @@
+#include "WorldGen.h"
+
+#include <algorithm>
+#include <chrono>
+
+WorldGenerator::~WorldGenerator() {
+	if (builder.joinable()) {
+		stopRequested.store(true);
+		builder.join();
+	}
+	GeneratedSystem* system;
+	while (systems.pop(system)) {
+		delete system->core;
+		for (DynamicGravBody* planet : system->planets) {
+			delete planet;
+		}
+		delete system;
+	}
+	if (staging != nullptr) {
+		if (!populated) {
+			for (City* city : staging->cities) {
+				delete city;
+			}
+		}
+		// the bodies in staging were built for the world, which deletes them
+		staging->staticGravBodies.clear();
+		staging->dynamicGravBodies.clear();
+		staging->cities.clear();
+		delete staging;
+	}
+}
+
+void WorldGenerator::start(double systemRad, double systemPad, int seed, double areaSize) {
+	this->systemRad = systemRad;
+	playSpaceSystems(systemRad, systemPad, seed, areaSize, sites);
+
+	// the player spawns at the origin
+	order.clear();
+	readyCount = 0;
+	for (int i = 0; i < (int)sites.size(); i++) {
+		order.push_back(i);
+		if (sites[i].location.magnitude() <= WORLDGENREADYRADIUS) {
+			readyCount++;
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+		return sites[a].location.magnitude() < sites[b].location.magnitude();
+	});
+	if (readyCount == 0 and !sites.empty()) {
+		readyCount = 1;
+	}
+
+	staging = new GameState;
+	staging->seed = seed;
+	staging->entityCap = 0;
+	staging->deltaT = 0;
+	staging->player = nullptr;
+	builder = std::thread(&WorldGenerator::build, this);
+}
+
+// The builder thread, builds every system into staging in turn and hands it over, then the cities and entities.
+void WorldGenerator::build() {
+	PROFILE_ZONE("WorldGenerator::build");
+	std::vector<StaticGravBody*> cores(sites.size(), nullptr);
+	std::vector<std::vector<DynamicGravBody*>> planets(sites.size());
+	WorldRandom afterLast; // generatePlaySpace populates with the random state its last system left
+
+	for (int i : order) {
+		if (stopRequested.load(std::memory_order_relaxed)) {
+			return;
+		}
+		randSystemAt(sites[i].location, sites[i].seed, staging, systemRad);
+		GeneratedSystem* system = new GeneratedSystem;
+		system->core = staging->staticGravBodies.back();
+		system->planets = staging->dynamicGravBodies;
+		staging->staticGravBodies.clear();
+		staging->dynamicGravBodies.clear();
+		cores[i] = system->core;
+		planets[i] = system->planets;
+		if (i == (int)sites.size() - 1) {
+			afterLast = staging->random;
+		}
+
+		while (!systems.push(system)) {
+			if (stopRequested.load(std::memory_order_relaxed)) {
+				delete system->core;
+				for (DynamicGravBody* planet : system->planets) {
+					delete planet;
+				}
+				delete system;
+				return;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		built.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// the bodies in generatePlaySpace's order, populate picks from them by index and adopt puts state's in this order
+	for (int i = 0; i < (int)sites.size(); i++) {
+		staging->staticGravBodies.push_back(cores[i]);
+		staging->dynamicGravBodies.insert(staging->dynamicGravBodies.end(), planets[i].begin(), planets[i].end());
+	}
+	staging->random = afterLast;
+	populatePlaySpace(staging, false); // adopt starts the cities and builds the market in state
+	finished.store(true, std::memory_order_release);
+}
+
+bool WorldGenerator::adopt(GameState* state) {
+	if (populated) {
+		return true;
+	}
+	// read before the queue so every system pushed before finishing is taken in below
+	bool last = finished.load(std::memory_order_acquire);
+	bool added = false;
+
+	GeneratedSystem* system;
+	while (systems.pop(system)) {
+		system->core->bodyID = (int)state->staticGravBodies.size();
+		state->staticGravBodies.push_back(system->core);
+		for (DynamicGravBody* planet : system->planets) {
+			planet->bodyID = (int)state->dynamicGravBodies.size();
+			state->dynamicGravBodies.push_back(planet);
+		}
+		delete system;
+		adopted++;
+		added = true;
+	}
+
+	if (last) {
+		builder.join();
+		// every system is in, put them back in site order and take the random state populating left so the
+		// world plays out the same as one from generatePlaySpace
+		state->staticGravBodies.assign(staging->staticGravBodies.begin(), staging->staticGravBodies.end());
+		state->dynamicGravBodies.assign(staging->dynamicGravBodies.begin(), staging->dynamicGravBodies.end());
+		for (int i = 0; i < (int)state->staticGravBodies.size(); i++) {
+			state->staticGravBodies[i]->bodyID = i;
+		}
+		for (int i = 0; i < (int)state->dynamicGravBodies.size(); i++) {
+			state->dynamicGravBodies[i]->bodyID = i;
+		}
+		state->random = staging->random;
+		state->spatialIndex.bodiesChanged(); // the same count in a new order
+		for (City* city : staging->cities) {
+			state->cities.push_back(city);
+			city->startAt(state); // from when it joins rather than when staging was populated
+		}
+		staging->cities.clear();
+		state->market.build(state);
+
+		// spawned again in state the way generatePlaySpace spawns them
+		int spawned = 0;
+		for (int k = 0; k < KINDCOUNT; k++) {
+			EntityArchetype& archetype = staging->entities.archetypes[k];
+			for (int i = 0; i < archetype.size(); i++) {
+				if (k == KindPirate) {
+					state->entities.spawnPirate(archetype.brain[i].behavior, archetype.location[i], archetype.navigation[i].destination);
+				}
+				else {
+					state->entities.spawnCargo(archetype.location[i], archetype.navigation[i].destination);
+				}
+				spawned++;
+			}
+		}
+		staging->entities.clear();
+		staging->staticGravBodies.clear();
+		staging->dynamicGravBodies.clear();
+		state->entityCap += spawned;
+		state->entities.reserve(state->entityCap);
+		state->projectilePool.reserve(state, PROJECTILEPOOLSTART);
+		populated = true;
+		added = true;
+	}
+
+	if (added) {
+		refreshBodyLanes(state);
+		// cached gravity was summed without the new bodies
+		if (state->player != nullptr) {
+			state->player->invalidateGravity();
+		}
+		for (int k = 0; k < KINDCOUNT; k++) {
+			for (GravityCache& cache : state->entities.archetypes[k].gravity) {
+				cache.invalidate();
+			}
+		}
+	}
+	return populated;
+}
+
+void startWorldGeneration(double systemRad, double systemPad, int seed, GameState* state) {
+	state->generator = new WorldGenerator;
+	state->generator->start(systemRad, systemPad, seed);
+}
+
+bool adoptGeneratedWorld(GameState* state) {
+	if (state->generator == nullptr) {
+		return true;
+	}
+	if (state->generator->adopt(state)) {
+		delete state->generator;
+		state->generator = nullptr;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,63 @@
+/*
+* Builds a play area on a thread of its own so the menu never waits on generatePlaySpace.
+* Systems are built nearest the spawn first and handed over one at a time through a lock-free queue. Whichever
+* thread owns the GameState takes them in with adopt(): the main thread while the menu is up, then update() once
+* play has started. Play can start as soon as the systems around the spawn are in and the rest arrive over the
+* next frames. The cities and their ships come last, once every body exists.
+* Each system is built from the same seed generatePlaySpace would give it. Once the last is in, adopt() puts the bodies
+* in generatePlaySpace's order and takes the random state it would leave, so a seed plays the same world either way.
+*/
+
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "GameData.h"
+#include "LockFree.h"
+
+static const double WORLDGENREADYRADIUS = 2500; // systems whose centers are this close to the spawn are in before play starts
+static const int WORLDGENQUEUESIZE = 64; // built systems waiting to be taken in, the builder waits when it is full
+
+// One built system on its way into the world.
+struct GeneratedSystem {
+	StaticGravBody* core = nullptr;
+	std::vector<DynamicGravBody*> planets;
+};
+
+class WorldGenerator {
+private:
+	std::vector<SystemSite> sites; // in generatePlaySpace's order
+	std::vector<int> order; // indices into sites, nearest the spawn first
+	double systemRad = 0;
+	int readyCount = 0; // systems to take in before play starts
+	std::thread builder;
+	std::atomic<bool> stopRequested;
+	std::atomic<bool> finished; // the builder pushed every system and filled staging
+	std::atomic<int> built;
+	SPSCQueue<GeneratedSystem*, WORLDGENQUEUESIZE> systems;
+	GameState* staging = nullptr; // the builder's own world, holds the cities and entities until they are taken in
+	int adopted = 0;
+	bool populated = false;
+
+	void build();
+public:
+	WorldGenerator() : stopRequested(false), finished(false), built(0) {}
+	// Stops the builder and deletes whatever was not taken in.
+	~WorldGenerator();
+	// Starts building the world generatePlaySpace(systemRad, systemPad, seed, state, areaSize) would, spawn outward.
+	void start(double systemRad, double systemPad, int seed, double areaSize = AREASIZE);
+	// Takes whatever has been built into state, returns true once the whole world is in and this can be deleted.
+	// Only called by the thread that owns state.
+	bool adopt(GameState* state);
+	// The systems around the spawn are in.
+	bool isReady() const { return adopted >= readyCount; }
+	int systemsBuilt() const { return built.load(std::memory_order_relaxed); }
+	int systemsAdopted() const { return adopted; }
+	int systemCount() const { return (int)sites.size(); }
+};
+
+// Starts building a world in the background for state, which must have no bodies, see GameState::generator.
+void startWorldGeneration(double systemRad, double systemPad, int seed, GameState* state);
+// Takes in what the generator for state has built and deletes it once it is done. Returns true if state has no generator left.
+bool adoptGeneratedWorld(GameState* state);
@@ -0,0 +1,278 @@
+/*
+* Microbenchmarks for BSLA and the GameData query functions across world sizes.
+* Results are printed as CSV (or JSON with --json) so runs can be compared for regressions.
+*
+* Usage: VectorSpaceBench [--json] [--max-bodies N] [--min-time seconds]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "GameData.h"
+#include "BSLA.h"
+
+struct BenchResult {
+	std::string name;
+	int bodies;
+	long long iterations;
+	double nsPerOp;
+};
+
+static double minTime = 0.25; // seconds each benchmark runs for at least
+static volatile double sink = 0; // keeps results from being optimized away
+static std::vector<BenchResult> results;
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs op(i) in growing batches until a batch takes minTime, then records the time per call.
+template <typename Op>
+static void runBench(const char* name, int bodies, Op op) {
+	long long iterations = 1;
+	while (true) {
+		double total = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (long long i = 0; i < iterations; i++) {
+			total += op(i);
+		}
+		double elapsed = secondsSince(start);
+		sink = sink + total;
+		if (elapsed >= minTime) {
+			results.push_back({ name, bodies, iterations, elapsed * 1e9 / iterations });
+			std::cerr << name << " (" << bodies << " bodies): " << elapsed * 1e9 / iterations << " ns\n";
+			return;
+		}
+		iterations *= (elapsed < minTime / 10) ? 10 : 2;
+	}
+}
+
+static const int POINTCOUNT = 1024; // a power of two
+static std::vector<Vector2D> randomPoints(double areaSize) {
+	std::vector<Vector2D> points;
+	for (int i = 0; i < POINTCOUNT; i++) {
+		double x = ((double)rand() / RAND_MAX * 2 - 1) * areaSize;
+		double y = ((double)rand() / RAND_MAX * 2 - 1) * areaSize;
+		points.push_back(Vector2D(x, y));
+	}
+	return points;
+}
+
+static void benchBSLA() {
+	srand(1);
+	std::vector<Vector2D> a = randomPoints(1000);
+	std::vector<Vector2D> b = randomPoints(1000);
+	std::vector<Matrix2D> m;
+	for (int i = 0; i < POINTCOUNT; i++) {
+		m.push_back(Matrix2D(a[i].x, a[i].y, b[i].x, b[i].y));
+	}
+	const int mask = POINTCOUNT - 1;
+
+	runBench("Vector2D::operator+", 0, [&](long long i) { return (a[i & mask] + b[i & mask]).evalX(); });
+	runBench("Vector2D::operator-", 0, [&](long long i) { return (a[i & mask] - b[i & mask]).evalX(); });
+	runBench("Vector2D::operator*", 0, [&](long long i) { return (a[i & mask] * 1.5).evalX(); });
+	runBench("Vector2D::dot", 0, [&](long long i) { return a[i & mask].dot(b[i & mask]); });
+	runBench("Vector2D::magnitude", 0, [&](long long i) { return a[i & mask].magnitude(); });
+	runBench("Vector2D::normalize", 0, [&](long long i) { return a[i & mask].normalize().evalX(); });
+	runBench("Vector2D::proj", 0, [&](long long i) { return a[i & mask].proj(b[i & mask]).evalX(); });
+	runBench("Vector2D::cmpMag", 0, [&](long long i) { return (double)a[i & mask].cmpMag(b[i & mask]); });
+	runBench("Matrix2D::operator*(Matrix2D)", 0, [&](long long i) { return (m[i & mask] * m[(i + 1) & mask]).v1.x; });
+	runBench("Matrix2D::operator*(Vector2D)", 0, [&](long long i) { return (m[i & mask] * a[i & mask]).x; });
+	runBench("Matrix2D::inverse", 0, [&](long long i) { return m[i & mask].inverse().v1.x; });
+	runBench("Matrix2D::det", 0, [&](long long i) { return m[i & mask].det(); });
+	runBench("rotateVector2D", 0, [&](long long i) { return rotateVector2D(a[i & mask], (float)(i & 63) * 0.1f).x; });
+}
+
+// Flies the same orbit in float and double at the edge of an area and reports how far apart they end up.
+// This is the accuracy a VS_FLOAT_SIM build gives up, in world units.
+template <typename T>
+static Vec2<T> flyOrbit(int ticks, std::vector<Vec2<T>>& path) {
+	const Vec2<T> center = Vec2<T>(T(AREASIZE), T(AREASIZE));
+	const T mass = 5000; const T dt = T(1.0 / 144);
+	Vec2<T> location = center + Vec2<T>(300, 0);
+	Vec2<T> speed(0, T(sqrt(GCONST * mass / 300)));
+	for (int i = 0; i < ticks; i++) {
+		Vec2<T> toCenter = center - location;
+		T distance = toCenter.magnitude();
+		speed = speed + toCenter * (T(GCONST) * mass / (distance * distance * distance) * dt);
+		location = location + speed * dt;
+		path.push_back(location);
+	}
+	return location;
+}
+
+static void checkPrecision() {
+	const int ticks = 144 * 60;
+	std::vector<Vec2<float>> floatPath;
+	std::vector<Vec2<double>> doublePath;
+	flyOrbit<float>(ticks, floatPath);
+	flyOrbit<double>(ticks, doublePath);
+	double maxError = 0;
+	for (int i = 0; i < ticks; i++) {
+		maxError = std::max(maxError, (Vec2<double>(floatPath[i]) - doublePath[i]).magnitude());
+	}
+	std::cerr << "float vs double orbit at " << AREASIZE << " units over " << ticks << " ticks: max error " << maxError << " units\n";
+}
+
+// Builds a world with roughly targetBodies bodies using generatePlaySpace with a larger area.
+static double buildWorld(GameState* state, int targetBodies) {
+	const double systemRad = 1000; const double systemPad = 500;
+	const double bodiesPerSystem = 5.5; // a star and on average 4.5 planets
+	int perSide = (int)round(sqrt(targetBodies / bodiesPerSystem));
+	if (perSide < 1) {
+		perSide = 1;
+	}
+	double areaSize = perSide * (2 * systemRad + systemPad) / 2;
+
+	std::streambuf* out = std::cout.rdbuf(nullptr); // generation is chatty
+	generatePlaySpace(systemRad, systemPad, 1234, state, areaSize);
+	state->spatialIndex.rebuild(state);
+	std::cout.rdbuf(out);
+	std::cout.clear();
+	return areaSize;
+}
+
+static void benchWorld(int targetBodies) {
+	GameState* state = new GameState;
+	state->player = new PlayerShip();
+	state->curState = StagePlay;
+	state->resetFlag = false;
+	state->gamePause = false;
+	state->deltaT = 1.0f / 144;
+	double areaSize = buildWorld(state, targetBodies);
+	int bodies = (int)(state->staticGravBodies.size() + state->dynamicGravBodies.size());
+
+	srand(2);
+	std::vector<Vector2D> points = randomPoints(areaSize);
+	std::vector<Vector2D> destinations = randomPoints(areaSize);
+	const int mask = POINTCOUNT - 1;
+
+	runBench("doGravity", bodies, [&](long long i) { return doGravity(state, points[i & mask]).x; });
+	runBench("willCollide", bodies, [&](long long i) { return (double)(willCollide(state, points[i & mask]) != nullptr); });
+	runBench("bodyClearance", bodies, [&](long long i) { return bodyClearance(state, points[i & mask], 1000); });
+	runBench("closestToPoint", bodies, [&](long long i) { return closestToPoint(state, points[i & mask])->radius; });
+	runBench("avoidBodies", bodies, [&](long long i) {
+		Navigation nav;
+		nav.destination = destinations[i & mask];
+		avoidBodies(state, nav, points[i & mask]);
+		return nav.currentDest.x;
+	});
+	// a querier drifting about as fast as a ship, one get() per tick
+	GravityCache cache;
+	Vector2D walker = points[0];
+	runBench("GravityCache::get", bodies, [&](long long i) {
+		walker = walker + Vector2D(1, 0.5);
+		return cache.get(state, walker).x;
+	});
+	runBench("Projectile::update", bodies, [&](long long i) {
+		Projectile projectile(points[i & mask], Vector2D(1000, 0), 16, 0);
+		return (double)projectile.update(state);
+	});
+
+	std::streambuf* out = std::cout.rdbuf(nullptr);
+	resetGameState(state);
+	std::cout.rdbuf(out);
+	std::cout.clear();
+	delete state->player;
+	delete state;
+}
+
+// One NBodySystem::step for a star cluster of starCount moveType 4 bodies.
+static void benchNBody(int starCount) {
+	GameState* state = new GameState;
+	state->player = new PlayerShip();
+	state->deltaT = 1.0f / 144;
+	randClusterAt(Vector2D(0, 0), 1234, state, starCount, 4000);
+	refreshBodyLanes(state);
+
+	runBench("NBodySystem::step", starCount, [&](long long i) {
+		state->nbody.step(state);
+		return state->dynamicGravBodies[0]->location.x;
+	});
+
+	std::streambuf* out = std::cout.rdbuf(nullptr);
+	resetGameState(state);
+	std::cout.rdbuf(out);
+	std::cout.clear();
+	delete state->player;
+	delete state;
+}
+
+// One market tick over cityCount cities, every tick a full clearing of all MARKETGOODS goods.
+static void benchMarket(int cityCount) {
+	GameState* state = new GameState;
+	state->seed = 1234;
+	for (int i = 0; i < cityCount; i++) {
+		state->cities.push_back(new City(i % 2 == 0 ? 1.0f : -1.0f, 1000, i, nullptr));
+	}
+	state->market.build(state);
+
+	runBench("Market::tick", cityCount, [&](long long i) {
+		state->market.tick(MARKETTICK);
+		return (double)state->market.tradedLastTick;
+	});
+
+	for (City* city : state->cities) {
+		delete city;
+	}
+	state->cities.clear();
+	delete state;
+}
+
+int main(int argc, char* argv[]) {
+	bool json = false;
+	int maxBodies = 100000;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0) {
+			json = true;
+		}
+		else if (strcmp(argv[i], "--max-bodies") == 0 and i + 1 < argc) {
+			maxBodies = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--min-time") == 0 and i + 1 < argc) {
+			minTime = atof(argv[++i]);
+		}
+	}
+
+	checkPrecision();
+	benchBSLA();
+	for (int target : { 10, 100, 1000, 10000, 100000 }) {
+		if (target > maxBodies) {
+			break;
+		}
+		benchWorld(target);
+	}
+	for (int stars : { 500, 1000, 2000, 4000 }) {
+		if (stars > maxBodies) {
+			break;
+		}
+		benchNBody(stars);
+	}
+	for (int cities : { 100, 500, 2000 }) {
+		if (cities > maxBodies) {
+			break;
+		}
+		benchMarket(cities);
+	}
+
+	if (json) {
+		std::cout << "{\"results\":[\n";
+		for (int i = 0; i < (int)results.size(); i++) {
+			BenchResult& r = results[i];
+			std::cout << "{\"benchmark\":\"" << r.name << "\",\"bodies\":" << r.bodies << ",\"iterations\":" << r.iterations
+				<< ",\"ns_per_op\":" << r.nsPerOp << "}" << (i + 1 < (int)results.size() ? ",\n" : "\n");
+		}
+		std::cout << "]}\n";
+	}
+	else {
+		std::cout << "benchmark,bodies,iterations,ns_per_op\n";
+		for (BenchResult& r : results) {
+			std::cout << r.name << "," << r.bodies << "," << r.iterations << "," << r.nsPerOp << "\n";
+		}
+	}
+	return 0;
+}